@@ -0,0 +1,115 @@
+// Archive codec benchmark: compression ratio, encode and decode throughput of the .ktz format
+// (mesh_archive.h) at depths 1..N, against loading the same mesh from the raw mesh cache.
+//
+//   g++ -std=c++17 -O2 -pthread src/bench_codec.cpp -o bench_codec
+//   ./bench_codec --max-depth 7 --repeat 5 --threads 8
+//
+// Throughput is decoded vertex data (the size of the raw mesh) per second, so the columns are
+// directly comparable. Files go to mesh_cache/ and bench_codec.ktz in the working directory.
+
+#include "koch_generator.h"
+#include "mesh_archive.h"
+#include "mesh_cache.h"
+#include "mesh_export.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static double now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// best of repeat runs, in seconds
+template <typename Work>
+static double best(int repeat, Work work)
+{
+    double fastest = 1e30;
+    for (int i = 0; i < repeat; ++i)
+    {
+        double start = now();
+        work();
+        fastest = std::min(fastest, now() - start);
+    }
+    return fastest;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int maxDepth = 6;
+    int repeat = 3;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (arg == "--max-depth" && value)
+            maxDepth = (unsigned int)std::atoi(argv[++i]);
+        else if (arg == "--repeat" && value)
+            repeat = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--threads" && value)
+            threads = (unsigned int)std::max(1, std::atoi(argv[++i]));
+        else
+        {
+            std::printf("usage: bench_codec [--max-depth N] [--repeat N] [--threads N]\n");
+            return 2;
+        }
+    }
+
+    const double GB = 1e9;
+    std::printf("%5s %12s %12s %7s %11s %12s %12s %12s %12s %10s\n", "depth", "raw MB", "ktz MB", "ratio",
+                "enc GB/s", "dec 1T GB/s", "dec GB/s", "file GB/s", "cache GB/s", "max error");
+    const char *archivePath = "bench_codec.ktz";
+    for (unsigned int depth = 1; depth <= maxDepth; ++depth)
+    {
+        KochGenerator generator(depth);
+        std::vector<float> vertices = generator.generate();
+        double rawBytes = (double)vertices.size() * sizeof(float);
+
+        std::string archive;
+        double encodeSeconds = best(repeat, [&] { archive = encodeArchive(vertices, depth); });
+
+        std::vector<float> decoded;
+        const uint8_t *data = (const uint8_t *)archive.data();
+        bool ok = true;
+        double decodeOne = best(repeat, [&] { ok &= decodeArchive(data, archive.size(), decoded, 1); });
+        double decodeAll = best(repeat, [&] { ok &= decodeArchive(data, archive.size(), decoded, threads); });
+        float maxError = 0.0f;
+        for (size_t i = 0; ok && i < vertices.size(); ++i)
+            maxError = std::max(maxError, std::fabs(vertices[i] - decoded[i]));
+
+        // from disk (page cache): the archive read and decoded, against the raw cache mapped and copied out
+        FILE *file = std::fopen(archivePath, "wb");
+        if (file)
+        {
+            std::fwrite(archive.data(), 1, archive.size(), file);
+            std::fclose(file);
+        }
+        double fileSeconds = best(repeat, [&] { ok &= readArchive(archivePath, decoded, threads); });
+        MeshCache::store(generator.config(), vertices);
+        double cacheSeconds = best(repeat,
+                                   [&]
+                                   {
+                                       MappedMesh mesh;
+                                       ok &= MeshCache::load(generator.config(), mesh);
+                                       decoded.assign(mesh.data(), mesh.data() + mesh.floats());
+                                   });
+
+        std::printf("%5u %12.2f %12.3f %7.1f %11.3f %12.3f %12.3f %12.3f %12.3f %10.2g%s\n", depth, rawBytes / 1048576.0,
+                    archive.size() / 1048576.0, rawBytes / archive.size(), rawBytes / encodeSeconds / GB,
+                    rawBytes / decodeOne / GB, rawBytes / decodeAll / GB, rawBytes / fileSeconds / GB,
+                    rawBytes / cacheSeconds / GB, maxError, ok ? "" : "  DECODE FAILED");
+        std::fflush(stdout);
+        if (!ok)
+            return 1;
+    }
+    std::remove(archivePath);
+    return 0;
+}
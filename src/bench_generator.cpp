@@ -0,0 +1,342 @@
+// Generator micro-benchmark: runs every generator engine at depths 1..N and reports wall time,
+// triangles/sec, bytes emitted, heap allocations and peak RSS, as a table and as JSON.
+//
+//   g++ -std=c++17 -O2 -pthread src/bench_generator.cpp -o bench_generator
+//   ./bench_generator --max-depth 6 --repeat 5 --json bench.json
+//   ./bench_generator --max-depth 6 --compare bench.json --threshold 5
+//   ./bench_generator --max-depth 6 --perf      (hardware counters per triangle, Linux only)
+//   ./bench_generator --max-depth 6 --trace trace.json   (one extra traced pass per engine, for ui.perfetto.dev)
+//
+// Needs no OpenGL, so it runs anywhere the generator compiles.
+
+#include "koch_generator.h"
+#include "perf_counters.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#endif
+
+// heap accounting: every allocation in the process goes through these replacements.
+// GCC 11+ sees the inlined malloc/free pair through the replacements and warns about a
+// mismatch that is not there.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static std::atomic<unsigned long long> allocationCount(0);
+static std::atomic<unsigned long long> allocationBytes(0);
+
+void *operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+// peak resident set size in KiB. On Linux the high-water mark is reset before every run
+// through /proc/self/clear_refs, so each run reports its own peak rather than the process's.
+static void resetPeakRss()
+{
+#if defined(__linux__)
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    if (clearRefs)
+        clearRefs << "5";
+#endif
+}
+
+static long peakRssKiB()
+{
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::atol(line.c_str() + 6);
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return usage.ru_maxrss;
+#endif
+    return 0;
+}
+
+struct Result
+{
+    std::string engine;
+    unsigned int depth = 0;
+    double seconds = 0.0; // best of the repeats
+    double medianSeconds = 0.0;
+    unsigned long long triangles = 0;
+    unsigned long long bytes = 0;
+    unsigned long long allocations = 0;
+    unsigned long long allocatedBytes = 0;
+    long peakRssKiB = 0;
+
+    double trianglesPerSecond() const { return seconds > 0.0 ? triangles / seconds : 0.0; }
+};
+
+static Result run(const GeneratorEngine &engine, unsigned int depth, int repeat)
+{
+    Result result;
+    result.engine = engine.name;
+    result.depth = depth;
+    std::vector<double> times;
+    for (int r = 0; r < repeat; ++r)
+    {
+        resetPeakRss();
+        unsigned long long countBefore = allocationCount.load();
+        unsigned long long bytesBefore = allocationBytes.load();
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<float> vertices = engine.generate(KochGenerator(depth));
+
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double>(end - start).count());
+        // allocations and RSS are deterministic enough that the first run is representative
+        if (r == 0)
+        {
+            result.allocations = allocationCount.load() - countBefore;
+            result.allocatedBytes = allocationBytes.load() - bytesBefore;
+            result.peakRssKiB = peakRssKiB();
+            result.triangles = vertices.size() / 18;
+            result.bytes = vertices.size() * sizeof(float);
+        }
+    }
+    std::sort(times.begin(), times.end());
+    result.seconds = times.front();
+    result.medianSeconds = times[times.size() / 2];
+    return result;
+}
+
+// one object per line, so the compare mode can read it back without a JSON library
+static void writeJson(const std::vector<Result> &results, const std::string &path)
+{
+    std::ofstream file(path, std::ios::trunc);
+    file << "{\"results\": [\n";
+    char line[512];
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result &r = results[i];
+        std::snprintf(line, sizeof(line),
+                      "  {\"engine\": \"%s\", \"depth\": %u, \"seconds\": %.9f, \"median_seconds\": %.9f, "
+                      "\"triangles\": %llu, \"triangles_per_second\": %.1f, \"bytes\": %llu, "
+                      "\"allocations\": %llu, \"allocated_bytes\": %llu, \"peak_rss_kib\": %ld}%s\n",
+                      r.engine.c_str(), r.depth, r.seconds, r.medianSeconds, r.triangles, r.trianglesPerSecond(),
+                      r.bytes, r.allocations, r.allocatedBytes, r.peakRssKiB, i + 1 < results.size() ? "," : "");
+        file << line;
+    }
+    file << "]}\n";
+}
+
+static bool field(const std::string &line, const char *key, std::string &value)
+{
+    std::string pattern = std::string("\"") + key + "\": ";
+    size_t at = line.find(pattern);
+    if (at == std::string::npos)
+        return false;
+    at += pattern.size();
+    size_t end = line.find_first_of(",}", at);
+    value = line.substr(at, end - at);
+    if (!value.empty() && value[0] == '"')
+        value = value.substr(1, value.size() - 2);
+    return true;
+}
+
+static std::vector<Result> readJson(const std::string &path)
+{
+    std::vector<Result> results;
+    std::ifstream file(path);
+    std::string line, value;
+    while (std::getline(file, line))
+    {
+        Result r;
+        if (!field(line, "engine", r.engine))
+            continue;
+        if (field(line, "depth", value)) r.depth = (unsigned int)std::stoul(value);
+        if (field(line, "seconds", value)) r.seconds = std::stod(value);
+        if (field(line, "median_seconds", value)) r.medianSeconds = std::stod(value);
+        if (field(line, "triangles", value)) r.triangles = std::stoull(value);
+        if (field(line, "bytes", value)) r.bytes = std::stoull(value);
+        if (field(line, "allocations", value)) r.allocations = std::stoull(value);
+        if (field(line, "allocated_bytes", value)) r.allocatedBytes = std::stoull(value);
+        if (field(line, "peak_rss_kib", value)) r.peakRssKiB = std::stol(value);
+        results.push_back(r);
+    }
+    return results;
+}
+
+// prints the change against the baseline; returns the number of regressions beyond threshold
+static int compare(const std::vector<Result> &results, const std::vector<Result> &baseline, double thresholdPercent)
+{
+    int regressions = 0;
+    std::printf("\n%-10s %5s %12s %12s %9s %14s %14s\n", "engine", "depth", "base s", "now s", "time", "allocs", "peak RSS");
+    for (const Result &now : results)
+    {
+        auto it = std::find_if(baseline.begin(), baseline.end(), [&now](const Result &b)
+                               { return b.engine == now.engine && b.depth == now.depth; });
+        if (it == baseline.end())
+            continue;
+        double change = it->seconds > 0.0 ? (now.seconds / it->seconds - 1.0) * 100.0 : 0.0;
+        bool regressed = change > thresholdPercent || now.triangles != it->triangles;
+        regressions += regressed;
+        std::printf("%-10s %5u %12.6f %12.6f %+8.1f%% %+14lld %+13ldK%s\n", now.engine.c_str(), now.depth,
+                    it->seconds, now.seconds, change, (long long)now.allocations - (long long)it->allocations,
+                    now.peakRssKiB - it->peakRssKiB, regressed ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+// one extra run per engine and depth under hardware counters: generation as a whole, then the
+// normal/colour classification step replayed on its own over the generated triangles
+static void printPerfCounters(const std::vector<const GeneratorEngine *> &engines, unsigned int maxDepth)
+{
+    PerfCounters counters;
+    if (!counters.available())
+    {
+        std::cout << "\nperf counters unavailable (no perf_event_open access here); skipping" << std::endl;
+        return;
+    }
+    PerfReport report;
+    for (const GeneratorEngine *engine : engines)
+    {
+        for (unsigned int depth = 1; depth <= maxDepth; ++depth)
+        {
+            std::string label = std::string(engine->name) + " d" + std::to_string(depth);
+            counters.start();
+            KochGenerator generator(depth);
+            std::vector<float> vertices = engine->generate(generator);
+            PerfCounters::Sample generation = counters.stop();
+            unsigned long long triangles = vertices.size() / 18;
+
+            counters.start();
+            volatile unsigned long long checksum = generator.classifyMesh(vertices);
+            PerfCounters::Sample classification = counters.stop();
+            (void)checksum;
+
+            report.add(label + " generate", generation, triangles);
+            report.add(label + " classify", classification, triangles);
+        }
+    }
+    std::cout << std::endl;
+    report.print(std::cout);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int maxDepth = 5;
+    int repeat = 3;
+    double threshold = 5.0;
+    bool perf = false;
+    std::string jsonPath, comparePath, tracePath;
+    std::vector<const GeneratorEngine *> engines;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (arg == "--max-depth" && value)
+            maxDepth = (unsigned int)std::atoi(argv[++i]);
+        else if (arg == "--repeat" && value)
+            repeat = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--engine" && value)
+        {
+            const GeneratorEngine *engine = findGeneratorEngine(argv[++i]);
+            if (!engine)
+            {
+                std::cout << "unknown engine: " << argv[i] << std::endl;
+                return 2;
+            }
+            engines.push_back(engine);
+        }
+        else if (arg == "--json" && value)
+            jsonPath = argv[++i];
+        else if (arg == "--compare" && value)
+            comparePath = argv[++i];
+        else if (arg == "--threshold" && value)
+            threshold = std::atof(argv[++i]);
+        else if (arg == "--perf")
+            perf = true;
+        else if (arg == "--trace" && value)
+            tracePath = argv[++i];
+        else
+        {
+            std::cout << "usage: bench_generator [--max-depth N] [--repeat N] [--engine NAME]...\n"
+                         "                       [--json out.json] [--compare baseline.json] [--threshold percent] [--perf]\n"
+                         "                       [--trace trace.json]"
+                      << std::endl;
+            return 2;
+        }
+    }
+    if (engines.empty())
+        for (const GeneratorEngine &engine : generatorEngines)
+            engines.push_back(&engine);
+
+    std::vector<Result> results;
+    std::printf("%-10s %5s %12s %14s %12s %12s %14s %10s\n", "engine", "depth", "seconds", "triangles/s",
+                "MB emitted", "allocations", "MB allocated", "peak RSS");
+    for (const GeneratorEngine *engine : engines)
+    {
+        for (unsigned int depth = 1; depth <= maxDepth; ++depth)
+        {
+            Result r = run(*engine, depth, repeat);
+            std::printf("%-10s %5u %12.6f %14.0f %12.2f %12llu %14.2f %9ldK\n", r.engine.c_str(), r.depth, r.seconds,
+                        r.trianglesPerSecond(), r.bytes / 1048576.0, r.allocations, r.allocatedBytes / 1048576.0,
+                        r.peakRssKiB);
+            std::fflush(stdout);
+            results.push_back(r);
+        }
+    }
+
+    if (perf)
+        printPerfCounters(engines, maxDepth);
+
+    // traced separately so the recording cost never shows up in the timings above
+    if (!tracePath.empty())
+    {
+        Trace::start();
+        Trace::setThreadName("bench_generator");
+        for (const GeneratorEngine *engine : engines)
+            engine->generate(KochGenerator(maxDepth));
+        Trace::stop();
+        Trace::write(tracePath);
+    }
+
+    if (!jsonPath.empty())
+    {
+        writeJson(results, jsonPath);
+        std::cout << "results written to " << jsonPath << std::endl;
+    }
+    if (!comparePath.empty())
+    {
+        std::vector<Result> baseline = readJson(comparePath);
+        if (baseline.empty())
+        {
+            std::cout << "no results in " << comparePath << std::endl;
+            return 2;
+        }
+        int regressions = compare(results, baseline, threshold);
+        if (regressions)
+        {
+            std::cout << regressions << " regression(s) beyond " << threshold << "%" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,247 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "camera.h"
+#include "renderer.h"
+#include "offscreen_context.h"
+
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+// Headless rendering benchmark: `koch_tetrahedron benchmark [options]`.
+//
+// Renders into an offscreen framebuffer through the same Renderer the viewer uses, driving the
+// existing Camera class along a scripted path with a fixed 60 Hz timestep so every run (and every
+// commit) replays exactly the same frames. At most two frames are kept in flight with fences,
+// mimicking a swap chain, and frame time is the wall time between consecutive frame completions.
+
+struct BenchmarkOptions
+{
+    std::vector<unsigned int> depths = {1, 2, 3, 4};
+    std::vector<int> modes = {0, 1, 2}; // indices into renderModes
+    int frames = 600;
+    int warmup = 60;
+    int width = 1280;
+    int height = 720;
+    std::string outPath; // CSV, optional
+};
+
+typedef std::vector<float> (*MeshGenerator)(unsigned int depth);
+
+// parses the arguments after "benchmark"; prints usage and returns false on anything unknown
+inline bool parseBenchmarkArgs(int argc, char **argv, BenchmarkOptions &options)
+{
+    for (int i = 0; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (arg == "--depths" && value)
+        {
+            // "1-5" or "1,3,5"
+            options.depths.clear();
+            unsigned int first = 0, last = 0;
+            if (std::sscanf(value, "%u-%u", &first, &last) == 2)
+                for (unsigned int d = first; d <= last; ++d)
+                    options.depths.push_back(d);
+            else
+                for (const char *p = value; *p; ++p)
+                    if (p == value || p[-1] == ',')
+                        options.depths.push_back((unsigned int)std::atoi(p));
+            ++i;
+        }
+        else if (arg == "--modes" && value)
+        {
+            options.modes.clear();
+            for (int m = 0; m < renderModeCount; ++m)
+                if (std::strstr(value, renderModes[m].name))
+                    options.modes.push_back(m);
+            ++i;
+        }
+        else if (arg == "--frames" && value)
+            options.frames = std::atoi(argv[++i]);
+        else if (arg == "--warmup" && value)
+            options.warmup = std::atoi(argv[++i]);
+        else if (arg == "--size" && value)
+        {
+            std::sscanf(value, "%dx%d", &options.width, &options.height);
+            ++i;
+        }
+        else if (arg == "--out" && value)
+            options.outPath = argv[++i];
+        else
+        {
+            std::cout << "usage: koch_tetrahedron benchmark [--depths 1-5|1,3,5] [--modes shaded,wireframe,debug]\n"
+                         "                                  [--frames N] [--warmup N] [--size WxH] [--out results.csv]"
+                      << std::endl;
+            return false;
+        }
+    }
+    return !options.depths.empty() && !options.modes.empty() && options.frames > 0;
+}
+
+// Advances the scripted camera/rotation path by one fixed step and returns the frame to draw.
+// Only Camera's public input methods are used, so the path exercises the same code as a user.
+inline FrameState scriptedFrame(Camera &camera, int frame, int frames, const BenchmarkOptions &options)
+{
+    const float step = 1.0f / 60.0f;
+    const float phase = 6.2831853f * (float)frame / (float)frames;
+
+    camera.ProcessMouseMovement(3.0f * std::cos(phase), 2.0f * std::sin(2.0f * phase));
+    camera.ProcessKeyboard((frame / 120) % 2 == 0 ? FORWARD : BACKWARD, step);
+    camera.ProcessKeyboard(std::sin(phase) > 0.0f ? LEFT : RIGHT, step * 0.5f);
+    camera.ProcessMouseScroll(0.2f * std::sin(phase));
+
+    FrameState state;
+    state.view = camera.GetViewMatrix();
+    state.zoom = camera.Zoom;
+    state.aspect = (float)options.width / (float)options.height;
+    state.framebufferWidth = options.width;
+    state.framebufferHeight = options.height;
+    float rotX = 360.0f * (float)frame / (float)frames;
+    float rotY = 25.0f * std::sin(phase);
+    state.model = glm::rotate(glm::mat4(1.0f), glm::radians(rotY), glm::vec3(1.0f, 0.0f, 0.0f));
+    state.model = glm::rotate(state.model, glm::radians(rotX), glm::vec3(0.0f, 1.0f, 0.0f));
+    return state;
+}
+
+inline int runBenchmark(const BenchmarkOptions &options, MeshGenerator generate)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    OffscreenContext offscreen;
+    if (!offscreen.create())
+    {
+        std::cout << "Failed to create an offscreen OpenGL context" << std::endl;
+        return -1;
+    }
+    if (!gladLoadGLLoader(offscreen.loader()))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        offscreen.destroy();
+        return -1;
+    }
+    std::string rendererName = (const char *)glGetString(GL_RENDERER);
+    std::cout << "benchmark: " << rendererName << " / " << (const char *)glGetString(GL_VERSION)
+              << " (" << offscreen.description << "), " << options.width << "x" << options.height
+              << ", " << options.frames << " frames after " << options.warmup << " warmup" << std::endl;
+
+    // offscreen target
+    unsigned int FBO, colorRBO, depthRBO;
+    glGenFramebuffers(1, &FBO);
+    glGenRenderbuffers(1, &colorRBO);
+    glGenRenderbuffers(1, &depthRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, options.width, options.height);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, options.width, options.height);
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "ERROR::BENCHMARK::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        offscreen.destroy();
+        return -1;
+    }
+
+    std::ofstream csv;
+    if (!options.outPath.empty())
+    {
+        csv.open(options.outPath, std::ios::trunc);
+        csv << "renderer,width,height,depth,mode,triangles,frames,seconds,fps,p50_ms,p95_ms,p99_ms,gpu_p50_ms\n";
+    }
+    std::printf("%5s  %-10s %12s %10s %9s %9s %9s %11s\n",
+                "depth", "mode", "triangles", "fps", "p50 ms", "p95 ms", "p99 ms", "gpu p50 ms");
+
+    {
+        Renderer renderer(offscreen.loader());
+        for (unsigned int depth : options.depths)
+        {
+            renderer.upload(generate(depth));
+            for (int mode : options.modes)
+            {
+                Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+                std::vector<double> frameMs;
+                frameMs.reserve(options.frames);
+                GLsync inFlight[2] = {0, 0};
+                renderer.profiler.reset();
+                // the clock starts where the last warmup frame ends (or here without warmup), so
+                // seconds and frameMs cover every timed frame
+                Clock::time_point start = Clock::now(), previous = start;
+
+                int total = options.warmup + options.frames;
+                for (int frame = 0; frame < total; ++frame)
+                {
+                    bool timed = frame >= options.warmup;
+                    renderer.profiler.enabled = timed;
+                    renderer.profiler.beginFrame();
+
+                    FrameState state = scriptedFrame(camera, frame, total, options);
+                    state.renderMode = mode;
+                    renderer.drawFrame(state);
+                    renderer.profiler.endFrame();
+
+                    // keep at most two frames queued, like a double-buffered swap chain would
+                    GLsync &slot = inFlight[frame % 2];
+                    if (slot)
+                    {
+                        glClientWaitSync(slot, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+                        glDeleteSync(slot);
+                    }
+                    slot = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+                    Clock::time_point now = Clock::now();
+                    if (frame + 1 == options.warmup)
+                        start = now;
+                    if (timed)
+                        frameMs.push_back(std::chrono::duration<double, std::milli>(now - previous).count());
+                    previous = now;
+                }
+                glFinish();
+                renderer.profiler.collectGpu();
+                double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+                for (GLsync &slot : inFlight)
+                    if (slot)
+                        glDeleteSync(slot);
+
+                std::sort(frameMs.begin(), frameMs.end());
+                auto pct = [&frameMs](double p)
+                { return frameMs.empty() ? 0.0 : frameMs[std::min(frameMs.size() - 1, (size_t)(p * (frameMs.size() - 1) + 0.5))]; };
+                double fps = seconds > 0.0 ? options.frames / seconds : 0.0;
+                double gpuP50 = renderer.profiler.percentile(renderer.scenePass, 0.5);
+                unsigned long long triangles = (unsigned long long)renderer.vertices() / 3;
+
+                std::printf("%5u  %-10s %12llu %10.1f %9.3f %9.3f %9.3f %11.3f\n", depth, renderModes[mode].name,
+                            triangles, fps, pct(0.50), pct(0.95), pct(0.99), gpuP50);
+                if (csv)
+                    csv << '"' << rendererName << "\"," << options.width << ',' << options.height << ','
+                        << depth << ',' << renderModes[mode].name << ',' << triangles << ',' << options.frames << ','
+                        << seconds << ',' << fps << ',' << pct(0.50) << ',' << pct(0.95) << ',' << pct(0.99) << ','
+                        << gpuP50 << '\n';
+            }
+        }
+        renderer.destroy();
+    }
+
+    glDeleteFramebuffers(1, &FBO);
+    glDeleteRenderbuffers(1, &colorRBO);
+    glDeleteRenderbuffers(1, &depthRBO);
+    offscreen.destroy();
+    if (csv)
+        std::cout << "results written to " << options.outPath << std::endl;
+    return 0;
+}
+#endif
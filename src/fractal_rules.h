@@ -0,0 +1,356 @@
+#ifndef FRACTAL_RULES_H
+#define FRACTAL_RULES_H
+
+#include "koch_generator.h"
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Fractal variants as compile-time policies of one generic kernel. A variant is three rules:
+//
+//   Subdivision  how a triangle above the depth limit splits, and which parts recurse
+//   Leaf         what a triangle at the limit turns into
+//   Attribute    the colour each emitted triangle gets
+//
+// plus an Output rule that decides what is written per triangle: the mesh itself, or where each
+// of its vertices sits one depth up (for geomorphing).
+//
+// FractalKernel<Subdivision, Leaf, Attribute, Output> instantiates a separate recursion per variant with
+// the rules inlined into it, so no variant pays for a runtime switch in the innermost loop. The
+// runtime choice happens once per mesh, through the fractalVariants table below.
+//
+// The kernel works on plain float triples instead of std::vector<float>, but repeats drawKT's
+// arithmetic operation for operation: the "koch" variant is byte-identical to
+// KochGenerator::generate().
+
+struct Vec3f
+{
+    float x, y, z;
+};
+
+inline Vec3f toVec3f(const std::vector<float> &v) { return {v[0], v[1], v[2]}; }
+
+inline Vec3f midpointOf(const Vec3f &c1, const Vec3f &c2)
+{
+    return {(c1.x + c2.x) / 2, (c1.y + c2.y) / 2, (c1.z + c2.z) / 2};
+}
+
+// normal(a, b, c) from koch_generator.h
+inline Vec3f normalOf(const Vec3f &a, const Vec3f &b, const Vec3f &c)
+{
+    Vec3f ab = {b.x - a.x, b.y - a.y, b.z - a.z};
+    Vec3f ac = {c.x - a.x, c.y - a.y, c.z - a.z};
+    Vec3f n = {ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x};
+    float length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+    if (length == 0.0f)
+        return {0.0f, 0.0f, 0.0f};
+    return {n.x / length, n.y / length, n.z / length};
+}
+
+// what every rule can see: the generator's settings, unpacked once per mesh
+struct FractalContext
+{
+    const KochGenerator *generator;
+    int maxDepth;
+    float apexHeightRatio;
+    Vec3f faceNormals[4];
+    Vec3f palette[4];
+    float *cursor; // next float to write; the caller sized the buffer from triangles()
+    // set while the last split emits the faces of its apex, which rises out of this point (ParentOutput)
+    const Vec3f *apexParent;
+
+    explicit FractalContext(const KochGenerator &source, float *out)
+        : generator(&source), maxDepth((int)source.depth()), apexHeightRatio(source.config().apexHeightRatio),
+          cursor(out), apexParent(NULL)
+    {
+        const KochConfig &config = source.config();
+        for (int i = 0; i < 4; ++i)
+        {
+            faceNormals[i] = normalOf(toVec3f(config.faces[i][0]), toVec3f(config.faces[i][1]),
+                                      toVec3f(config.faces[i][2]));
+            palette[i] = toVec3f(config.palette[i]);
+        }
+    }
+
+    static Vec3f centroidOf(const Vec3f &m1, const Vec3f &m2, const Vec3f &m3)
+    {
+        return {(m1.x + m2.x + m3.x) / 3.0f, (m1.y + m2.y + m3.y) / 3.0f, (m1.z + m2.z + m3.z) / 3.0f};
+    }
+
+    // KochGenerator::subdivide's apex, raised sign * apexHeightRatio * edge over the centroid of m1 m2 m3
+    Vec3f apex(const Vec3f &m1, const Vec3f &m2, const Vec3f &m3, float sign) const
+    {
+        Vec3f n = normalOf(m1, m2, m3);
+        float edgeLength = std::sqrt((m1.x - m2.x) * (m1.x - m2.x) + (m1.y - m2.y) * (m1.y - m2.y) +
+                                     (m1.z - m2.z) * (m1.z - m2.z));
+        float height = apexHeightRatio * edgeLength * sign;
+        Vec3f centroid = centroidOf(m1, m2, m3);
+        return {centroid.x + n.x * height, centroid.y + n.y * height, centroid.z + n.z * height};
+    }
+};
+
+// ----------------------------------------------------------------------------------------------
+// attribute rules: color(context, a, b, c, face) -> the triangle's colour
+
+// KochGenerator::classifyFace: the palette entry of the base face closest in orientation
+struct FaceNormalColor
+{
+    static const Vec3f &color(const FractalContext &context, const Vec3f &a, const Vec3f &b, const Vec3f &c, int)
+    {
+        Vec3f n = normalOf(a, b, c);
+        float maxDot = -1.0f;
+        int bestFace = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            const Vec3f &f = context.faceNormals[i];
+            float dot = std::abs(n.x * f.x + n.y * f.y + n.z * f.z);
+            if (dot > maxDot)
+            {
+                maxDot = dot;
+                bestFace = i;
+            }
+        }
+        return context.palette[bestFace];
+    }
+};
+
+// the colour of the base face the triangle descends from; no per-triangle work at all
+struct BaseFaceColor
+{
+    static const Vec3f &color(const FractalContext &context, const Vec3f &, const Vec3f &, const Vec3f &, int face)
+    {
+        return context.palette[face];
+    }
+};
+
+template <typename Attribute>
+inline void emitTriangle(FractalContext &context, const Vec3f &a, const Vec3f &b, const Vec3f &c, int face)
+{
+    const Vec3f &color = Attribute::color(context, a, b, c, face);
+    const float triangle[18] = {a.x, a.y, a.z, color.x, color.y, color.z,
+                                b.x, b.y, b.z, color.x, color.y, color.z,
+                                c.x, c.y, c.z, color.x, color.y, color.z};
+    std::memcpy(context.cursor, triangle, sizeof(triangle));
+    context.cursor += 18;
+}
+
+// ----------------------------------------------------------------------------------------------
+// output rules: triangle<Attribute>(context, a, b, c, face) writes `floats` floats per triangle
+
+// the mesh: position and colour per vertex
+struct VertexOutput
+{
+    static const unsigned int floats = 18;
+    static const bool parents = false;
+
+    template <typename Attribute>
+    static void triangle(FractalContext &context, const Vec3f &a, const Vec3f &b, const Vec3f &c, int face)
+    {
+        emitTriangle<Attribute>(context, a, b, c, face);
+    }
+};
+
+// Each vertex's position one depth up, in the same order as VertexOutput: blending from it to the
+// vertex morphs the depth-(n-1) surface into the depth-n one. Only the last split adds vertices
+// off that surface, the apexes; every other vertex lies on it already and is its own parent.
+struct ParentOutput
+{
+    static const unsigned int floats = 9;
+    static const bool parents = true;
+
+    template <typename Attribute>
+    static void triangle(FractalContext &context, const Vec3f &a, const Vec3f &b, const Vec3f &c, int)
+    {
+        // the apex is always the third vertex of its faces
+        const Vec3f &top = context.apexParent ? *context.apexParent : c;
+        const float triangle[9] = {a.x, a.y, a.z, b.x, b.y, b.z, top.x, top.y, top.z};
+        std::memcpy(context.cursor, triangle, sizeof(triangle));
+        context.cursor += 9;
+    }
+};
+
+// ----------------------------------------------------------------------------------------------
+// leaf rules: emit<Output, Attribute>(context, a, b, c, face), `triangles` per leaf
+
+// the triangle itself, as drawKT's drawTriangle
+struct FlatLeaf
+{
+    static const unsigned int triangles = 1;
+
+    template <typename Output, typename Attribute>
+    static void emit(FractalContext &context, const Vec3f &a, const Vec3f &b, const Vec3f &c, int face)
+    {
+        Output::template triangle<Attribute>(context, a, b, c, face);
+    }
+};
+
+// a small tetrahedron standing on the triangle: its three sides (the base is hidden against the surface)
+struct PyramidLeaf
+{
+    static const unsigned int triangles = 3;
+
+    template <typename Output, typename Attribute>
+    static void emit(FractalContext &context, const Vec3f &a, const Vec3f &b, const Vec3f &c, int face)
+    {
+        Vec3f top = context.apex(a, b, c, 1.0f);
+        Output::template triangle<Attribute>(context, a, b, top, face);
+        Output::template triangle<Attribute>(context, b, c, top, face);
+        Output::template triangle<Attribute>(context, c, a, top, face);
+    }
+};
+
+// ----------------------------------------------------------------------------------------------
+// subdivision rules: split<Kernel>(context, a, b, c, depth, face), and leaves(generator), the
+// number of leaf triangles the whole mesh ends in
+
+// drawKT: a tetrahedron raised (Sign 1) or sunk (Sign -1) on the midpoint triangle, plus the three
+// corners, which recurse while KochConfig::cornerLevels allows and are flat leaves after that
+template <int Sign>
+struct ApexSubdivision
+{
+    static unsigned long long leaves(const KochGenerator &generator) { return generator.triangles(); }
+
+    template <typename Kernel>
+    static void split(FractalContext &context, const Vec3f &a, const Vec3f &b, const Vec3f &c, int depth,
+                      int face)
+    {
+        Vec3f mid1 = midpointOf(c, a);
+        Vec3f mid2 = midpointOf(a, b);
+        Vec3f mid3 = midpointOf(b, c);
+        Vec3f top = context.apex(mid1, mid2, mid3, (float)Sign);
+
+        // the last split's apex rises out of the midpoint triangle's centroid
+        Vec3f base;
+        const bool morphs = Kernel::OutputRule::parents && depth + 1 >= context.maxDepth;
+        if (morphs)
+        {
+            base = FractalContext::centroidOf(mid1, mid2, mid3);
+            context.apexParent = &base;
+        }
+        Kernel::draw(context, mid1, mid2, top, depth + 1, face);
+        Kernel::draw(context, mid2, mid3, top, depth + 1, face);
+        Kernel::draw(context, mid3, mid1, top, depth + 1, face);
+        if (morphs)
+            context.apexParent = NULL;
+        if (context.generator->recursesCorners(depth))
+        {
+            Kernel::draw(context, a, mid2, mid1, depth + 1, face);
+            Kernel::draw(context, b, mid3, mid2, depth + 1, face);
+            Kernel::draw(context, c, mid1, mid3, depth + 1, face);
+        }
+        else
+        {
+            Kernel::leaf(context, mid2, mid1, a, face);
+            Kernel::leaf(context, mid3, mid2, b, face);
+            Kernel::leaf(context, mid1, mid3, c, face);
+        }
+    }
+};
+
+// Sierpinski: the midpoint triangle is cut out and only the corners recurse
+struct CornerSubdivision
+{
+    static unsigned long long leaves(const KochGenerator &generator)
+    {
+        unsigned long long count = 4;
+        for (unsigned int i = 0; i < generator.depth(); ++i)
+            count *= 3;
+        return count;
+    }
+
+    template <typename Kernel>
+    static void split(FractalContext &context, const Vec3f &a, const Vec3f &b, const Vec3f &c, int depth,
+                      int face)
+    {
+        Vec3f mid1 = midpointOf(c, a);
+        Vec3f mid2 = midpointOf(a, b);
+        Vec3f mid3 = midpointOf(b, c);
+        Kernel::draw(context, a, mid2, mid1, depth + 1, face);
+        Kernel::draw(context, mid2, b, mid3, depth + 1, face);
+        Kernel::draw(context, mid1, mid3, c, depth + 1, face);
+    }
+};
+
+// ----------------------------------------------------------------------------------------------
+
+template <typename Subdivision, typename Leaf, typename Attribute, typename Output = VertexOutput>
+struct FractalKernel
+{
+    typedef Output OutputRule;
+
+    static void draw(FractalContext &context, const Vec3f &a, const Vec3f &b, const Vec3f &c, int depth,
+                     int face)
+    {
+        if (depth < context.maxDepth)
+            Subdivision::template split<FractalKernel>(context, a, b, c, depth, face);
+        else
+            leaf(context, a, b, c, face);
+    }
+
+    static void leaf(FractalContext &context, const Vec3f &a, const Vec3f &b, const Vec3f &c, int face)
+    {
+        Leaf::template emit<Output, Attribute>(context, a, b, c, face);
+    }
+
+    static unsigned long long triangles(const KochGenerator &generator)
+    {
+        return Subdivision::leaves(generator) * Leaf::triangles;
+    }
+
+    // writes the whole mesh to out, which must hold triangles(generator) * Output::floats floats;
+    // returns the end
+    static float *generateInto(const KochGenerator &generator, float *out)
+    {
+        FractalContext context(generator, out);
+        const KochConfig &config = generator.config();
+        for (int i = 0; i < 4; ++i)
+            draw(context, toVec3f(config.faces[i][0]), toVec3f(config.faces[i][1]), toVec3f(config.faces[i][2]), 0,
+                 i);
+        return context.cursor;
+    }
+
+    static std::vector<float> generate(const KochGenerator &generator)
+    {
+        TRACE_SCOPE("generate kernel");
+        std::vector<float> vertices((size_t)triangles(generator) * Output::floats);
+        generateInto(generator, vertices.data());
+        return vertices;
+    }
+};
+
+typedef FractalKernel<ApexSubdivision<1>, FlatLeaf, FaceNormalColor> KochKernel;
+typedef FractalKernel<ApexSubdivision<-1>, FlatLeaf, FaceNormalColor> AntiKochKernel;
+typedef FractalKernel<CornerSubdivision, PyramidLeaf, BaseFaceColor> SierpinskiKernel;
+typedef FractalKernel<ApexSubdivision<1>, FlatLeaf, FaceNormalColor, ParentOutput> KochParentKernel;
+typedef FractalKernel<ApexSubdivision<-1>, FlatLeaf, FaceNormalColor, ParentOutput> AntiKochParentKernel;
+
+inline std::vector<float> generateKochKernel(const KochGenerator &generator)
+{
+    return KochKernel::generate(generator);
+}
+
+// variants selectable by name from the viewer (--variant=) and the command line (--variant).
+// parents (3 floats per vertex, see ParentOutput) is NULL for variants whose depth n-1 is not a
+// collapsed depth n: a Sierpinski level's pyramids do not grow out of the previous level's.
+struct FractalVariant
+{
+    const char *name;
+    std::vector<float> (*generate)(const KochGenerator &generator);
+    unsigned long long (*triangles)(const KochGenerator &generator);
+    std::vector<float> (*parents)(const KochGenerator &generator);
+};
+const FractalVariant fractalVariants[] = {
+    {"koch", KochKernel::generate, KochKernel::triangles, KochParentKernel::generate},
+    {"anti-koch", AntiKochKernel::generate, AntiKochKernel::triangles, AntiKochParentKernel::generate},
+    {"sierpinski", SierpinskiKernel::generate, SierpinskiKernel::triangles, NULL}};
+
+inline const FractalVariant *findFractalVariant(const char *name)
+{
+    for (const FractalVariant &variant : fractalVariants)
+        if (std::string(variant.name) == name)
+            return &variant;
+    return NULL;
+}
+#endif
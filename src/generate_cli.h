@@ -0,0 +1,288 @@
+#ifndef GENERATE_CLI_H
+#define GENERATE_CLI_H
+
+#include "koch_generator.h"
+#include "mesh_cache.h"
+#include "mesh_export.h"
+#include "out_of_core.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// `koch_tetrahedron generate`: runs only the generator (and an exporter), never GLFW or OpenGL,
+// so batch jobs can build meshes on machines without a display
+//
+//   koch_tetrahedron generate --depth 6 --engine parallel --out kt6.bin
+//   koch_tetrahedron generate --depth 8 --out kt8.stl       (format from the extension, or --format)
+//   koch_tetrahedron generate --depth 5 --variant sierpinski --out s5.ply
+//   koch_tetrahedron generate --depth 10 --out kt10.bin --out-of-core   (rerun to resume)
+//   koch_tetrahedron generate --depth 10 --out kt10.bin --shard 0/4     (one of four processes)
+//   koch_tetrahedron merge --depth 10 --out kt10.bin --shards 4        (verify the shards' checksums)
+//
+// Exports stream from the chunked generator so the mesh is never held in memory as a whole;
+// --engine, --cache and variants other than koch need the complete mesh and switch back to
+// generating it up front.
+//
+// depth and engine are runtime options here; the viewer itself still opens at defaultDepth
+struct GenerateOptions
+{
+    unsigned int depth = defaultDepth;
+    const GeneratorEngine *engine = &generatorEngines[0];
+    const FractalVariant *variant = &fractalVariants[0];
+    std::string outPath; // empty: generate and report only
+    const MeshFormat *format = NULL; // NULL: from the --out extension
+    bool engineChosen = false;
+    bool cache = false;  // also store the viewer's mesh cache entry, so its next launch just maps it
+    bool outOfCore = false;   // raw output written subtree by subtree into the mapped file, resumable
+    unsigned int threads = 0; // out-of-core workers, 0: all hardware threads
+    unsigned int shard = 0, shards = 1; // --shard i/N: this process's share of an out-of-core run
+    bool quiet = false;
+};
+
+// bounds and triangle count, accumulated chunk by chunk
+struct MeshStats
+{
+    unsigned long long triangles = 0;
+    float lo[3] = {0.0f, 0.0f, 0.0f}, hi[3] = {0.0f, 0.0f, 0.0f};
+
+    void add(const float *vertices, size_t count)
+    {
+        for (size_t i = 0; i < count * 3; ++i)
+            for (int k = 0; k < 3; ++k)
+            {
+                float v = vertices[i * 6 + k];
+                bool first = triangles == 0 && i == 0;
+                lo[k] = first || v < lo[k] ? v : lo[k];
+                hi[k] = first || v > hi[k] ? v : hi[k];
+            }
+        triangles += count;
+    }
+};
+
+inline bool parseGenerateArgs(int argc, char **argv, GenerateOptions &options)
+{
+    for (int i = 0; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (arg == "--depth" && value)
+            options.depth = (unsigned int)std::atoi(argv[++i]);
+        else if (arg == "--engine" && value)
+        {
+            options.engine = findGeneratorEngine(argv[++i]);
+            options.engineChosen = true;
+            if (!options.engine)
+            {
+                std::cout << "unknown engine: " << argv[i] << " (available:";
+                for (const GeneratorEngine &engine : generatorEngines)
+                    std::cout << " " << engine.name;
+                std::cout << ")" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--variant" && value)
+        {
+            options.variant = findFractalVariant(argv[++i]);
+            if (!options.variant)
+            {
+                std::cout << "unknown variant: " << argv[i] << " (available:";
+                for (const FractalVariant &variant : fractalVariants)
+                    std::cout << " " << variant.name;
+                std::cout << ")" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--out" && value)
+            options.outPath = argv[++i];
+        else if (arg == "--format" && value)
+        {
+            options.format = findMeshFormat(argv[++i]);
+            if (!options.format)
+            {
+                std::cout << "unknown format: " << argv[i] << " (available:";
+                for (const MeshFormat &format : meshFormats)
+                    std::cout << " " << format.name;
+                std::cout << ")" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--cache")
+            options.cache = true;
+        else if (arg == "--out-of-core")
+            options.outOfCore = true;
+        else if (arg == "--shard" && value)
+        {
+            if (!parseShard(argv[++i], options.shard, options.shards))
+            {
+                std::cout << "--shard expects i/N with i < N, got " << argv[i] << std::endl;
+                return false;
+            }
+            options.outOfCore = true;
+        }
+        else if (arg == "--threads" && value)
+            options.threads = (unsigned int)std::atoi(argv[++i]);
+        else if (arg == "--quiet")
+            options.quiet = true;
+        else
+        {
+            std::cout << "usage: koch_tetrahedron generate [--depth N] [--engine reference|parallel|kernel] [--out mesh.bin|.stl|.ply|.obj|.ktz]\n"
+                         "                                 [--variant koch|anti-koch|sierpinski] [--format raw|stl|ply|obj|ktz] [--cache] [--quiet]\n"
+                         "                                 [--out-of-core [--threads N]] [--shard i/N]"
+                      << std::endl;
+            return false;
+        }
+    }
+    if (options.outOfCore &&
+        (options.outPath.empty() || options.cache || (options.format && options.format != &meshFormats[0])))
+    {
+        std::cout << "--out-of-core needs --out and writes the raw format only" << std::endl;
+        return false;
+    }
+    if (options.variant != &fractalVariants[0] && (options.outOfCore || options.cache || options.engineChosen))
+    {
+        std::cout << "--variant other than koch cannot be combined with --engine, --cache or --out-of-core" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline int runOutOfCore(const GenerateOptions &options)
+{
+    OutOfCoreOptions job;
+    job.path = options.outPath;
+    job.depth = options.depth;
+    job.threads = options.threads;
+    OutOfCoreStats stats;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = options.shards > 1 ? generateShard(job, options.shard, options.shards, stats)
+                                 : generateOutOfCore(job, stats);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!options.quiet)
+    {
+        std::printf("depth        %u\n", options.depth);
+        if (options.shards > 1)
+            std::printf("shard        %u/%u\n", options.shard, options.shards);
+        std::printf("subtrees     %llu (%llu resumed, %llu generated)\n", stats.tasks, stats.resumed, stats.generated);
+        std::printf("bytes        %llu (%.2f GB) -> %s\n", stats.bytes, stats.bytes / 1e9, options.outPath.c_str());
+        std::printf("generate     %.3f s (%.1f MB/s)\n", seconds,
+                    seconds > 0.0 ? stats.bytes * (double)stats.generated / std::max(1ull, stats.tasks) / 1048576.0 / seconds : 0.0);
+    }
+    return ok ? 0 : 1;
+}
+
+// `koch_tetrahedron merge`: verifies a sharded run and writes its combined manifest
+inline int runMerge(int argc, char **argv)
+{
+    OutOfCoreOptions job;
+    unsigned int shards = 0;
+    for (int i = 0; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (arg == "--depth" && value)
+            job.depth = (unsigned int)std::atoi(argv[++i]);
+        else if (arg == "--out" && value)
+            job.path = argv[++i];
+        else if (arg == "--shards" && value)
+            shards = (unsigned int)std::atoi(argv[++i]);
+        else if (arg == "--threads" && value)
+            job.threads = (unsigned int)std::atoi(argv[++i]);
+        else
+        {
+            shards = 0;
+            break;
+        }
+    }
+    if (job.path.empty() || shards < 2 || job.depth > 12)
+    {
+        std::cout << "usage: koch_tetrahedron merge --depth N --out mesh.bin --shards N [--threads N]" << std::endl;
+        return -1;
+    }
+    unsigned long long verified = 0;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = mergeShards(job, shards, verified);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%s: %u shards, %.2f GB verified in %.3f s -> %s\n", ok ? "ok" : "FAILED", shards, verified / 1e9,
+                seconds, job.path.c_str());
+    return ok ? 0 : 1;
+}
+
+inline int runGenerate(const GenerateOptions &options)
+{
+    // 4 * 6^depth triangles of 72 bytes each; refuse before allocating rather than dying in bad_alloc
+    unsigned long long triangles = triangleCount(options.depth);
+    double bytes = (double)triangles * 18 * sizeof(float);
+    if (options.depth <= 12 && options.outOfCore)
+        return runOutOfCore(options);
+    if (options.depth > 12 || bytes > (double)(size_t)-1)
+    {
+        std::cout << "ERROR::GENERATE::DEPTH_TOO_LARGE: depth " << options.depth << " needs " << bytes / 1073741824.0
+                  << " GiB" << std::endl;
+        return 1;
+    }
+
+    const KochGenerator generator(options.depth);
+    const MeshFormat &format = options.format ? *options.format : meshFormatForPath(options.outPath);
+    const bool koch = options.variant == &fractalVariants[0];
+    triangles = options.variant->triangles(generator);
+    // the chunked planner follows the koch recursion only
+    bool streaming = koch && !options.outPath.empty() && !options.cache && !options.engineChosen;
+    MeshStats stats;
+    double seconds = 0.0, writeSeconds = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    if (streaming)
+    {
+        // generation and writing interleave here, so only the total is meaningful
+        if (!exportMeshStreaming(format, options.outPath, generator,
+                                 [&stats](const float *vertices, size_t count) { stats.add(vertices, count); }))
+            return 1;
+        writeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    else
+    {
+        std::vector<float> vertices = koch ? options.engine->generate(generator) : options.variant->generate(generator);
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.add(vertices.data(), vertices.size() / 18);
+
+        if (!options.outPath.empty())
+        {
+            auto writeStart = std::chrono::steady_clock::now();
+            if (!exportMesh(format, options.outPath, vertices, options.depth))
+                return 1;
+            writeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - writeStart).count();
+        }
+        if (options.cache && !MeshCache::store(generator.config(), vertices))
+            return 1;
+    }
+
+    if (!options.quiet)
+    {
+        size_t emitted = stats.triangles * 18 * sizeof(float);
+        std::printf("engine       %s\n", streaming ? "chunked (streaming export)" : koch ? options.engine->name : "kernel");
+        std::printf("variant      %s\n", options.variant->name);
+        std::printf("depth        %u\n", options.depth);
+        std::printf("triangles    %llu (expected %llu)\n", stats.triangles, triangles);
+        std::printf("vertices     %llu\n", stats.triangles * 3);
+        std::printf("bytes        %zu (%.2f MB of vertex data)\n", emitted, emitted / 1048576.0);
+        std::printf("bounds       [%g %g %g] - [%g %g %g]\n", stats.lo[0], stats.lo[1], stats.lo[2], stats.hi[0],
+                    stats.hi[1], stats.hi[2]);
+        if (!streaming)
+            std::printf("generate     %.6f s (%.0f triangles/s)\n", seconds,
+                        seconds > 0.0 ? stats.triangles / seconds : 0.0);
+        if (!options.outPath.empty())
+        {
+            std::error_code ec;
+            double fileBytes = (double)std::filesystem::file_size(options.outPath, ec);
+            std::printf("%-12s %.6f s -> %s (%s, %.2f MB, %.1f MB/s)\n", streaming ? "generate+write" : "write",
+                        writeSeconds, options.outPath.c_str(), format.name, fileBytes / 1048576.0,
+                        writeSeconds > 0.0 ? fileBytes / 1048576.0 / writeSeconds : 0.0);
+        }
+    }
+    return stats.triangles == triangles ? 0 : 1;
+}
+#endif
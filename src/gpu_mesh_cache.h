@@ -0,0 +1,489 @@
+#ifndef GPU_MESH_CACHE_H
+#define GPU_MESH_CACHE_H
+
+#include <glad/glad.h>
+
+#include "fractal_rules.h"
+#include "mesh_arena.h"
+#include "subtree_cull.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// the vertex layout meshes are generated in: interleaved position/colour, 6 floats per vertex.
+// Sets the attribute pointers of the bound vertex array to the bound GL_ARRAY_BUFFER.
+inline void configureMeshAttributes()
+{
+    // position attribute
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(0);
+    // color attribute
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+}
+
+// the layout in the cache's arena: the same followed by the parent position shader.vs morphs
+// from (ParentOutput in fractal_rules.h), 9 floats per vertex
+const size_t meshVertexBytes = 9 * sizeof(float);
+inline void configureMorphMeshAttributes()
+{
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, meshVertexBytes, (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, meshVertexBytes, (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    // parent position attribute
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, meshVertexBytes, (void *)(6 * sizeof(float)));
+    glEnableVertexAttribArray(3);
+}
+
+// which mesh: the depth and the index into fractalVariants
+struct GpuMeshKey
+{
+    unsigned int depth;
+    int variant;
+
+    bool operator==(const GpuMeshKey &other) const { return depth == other.depth && variant == other.variant; }
+};
+
+struct GpuMesh
+{
+    GpuMeshKey key;
+    size_t first;     // first vertex in the arena
+    GLsizei vertices;
+    size_t bytes;
+    GLuint bounds = 0;    // SubtreeBound buffer for SubtreeCuller, 0 without one
+    GLsizei subtrees = 0;
+};
+
+// Meshes for recently used depths and variants, kept resident in VRAM under a byte budget.
+//
+// All meshes live in one MeshArena the size of the budget and are drawn through its single vertex
+// array. A mesh that is not resident gets a range of the arena and is generated and written into
+// it on a background thread, followed by a fence; ranges are never reused while the GPU may still
+// read them, so the driver has nothing to synchronise against. The render thread keeps drawing the
+// current mesh and only switches once poll() sees the fence signalled; a resident mesh switches on
+// the next poll(). When a mesh does not fit, the least recently used ones (never the one being
+// drawn) are evicted, and their ranges return to the arena once the frames that used them are
+// done. When the free space is there but fragmented, the arena is compacted on the GPU.
+//
+// With subtreeBounds, each upload also builds the mesh's SubtreeBound buffer for SubtreeCuller
+// (GL 4.3), from the vertices it has at hand anyway. The bounds enclose the parent positions as
+// well, so they hold at every morph factor.
+//
+// The upload thread needs its own GL context sharing objects with the render context. Without
+// one (uploadContext is empty), uploads run synchronously on the render thread instead.
+class GpuMeshCache
+{
+public:
+    // upload(vertices, floats, parents): hands the mesh to the cache, 6 floats per vertex, with
+    // each vertex's parent position (3 floats) or NULL when the mesh does not morph; only valid
+    // during the source call
+    typedef std::function<void(const float *vertices, size_t floats, const float *parents)> Upload;
+    // produces the mesh for key by calling upload once; runs on the upload thread
+    typedef std::function<void(const GpuMeshKey &key, const Upload &upload)> Source;
+    // makes the upload context current (true) or releases it (false) on the calling thread
+    typedef std::function<void(bool current)> ContextSwitch;
+
+    // render thread, with its context current
+    GpuMeshCache(size_t budgetBytes, Source meshSource, ContextSwitch uploadContext, std::function<void()> wake,
+                 bool subtreeBounds = false)
+        : source(meshSource), contextSwitch(uploadContext), wakeRenderer(wake), buildBounds(subtreeBounds)
+    {
+        arena.create(budgetBytes / meshVertexBytes, meshVertexBytes, configureMorphMeshAttributes);
+        if (contextSwitch)
+            worker = std::thread(&GpuMeshCache::uploadLoop, this);
+    }
+    GpuMeshCache(const GpuMeshCache &) = delete;
+    GpuMeshCache &operator=(const GpuMeshCache &) = delete;
+
+    // render thread: show key as soon as it is resident
+    void request(const GpuMeshKey &key)
+    {
+        wanted = key;
+        hasWanted = true;
+        if (findResident(key))
+            return;
+        for (const GpuMeshKey &queued : waiting)
+            if (queued == key)
+                return;
+        for (const GpuMesh &mesh : uploading)
+            if (mesh.key == key)
+                return;
+        waiting.push_back(key);
+        startUploads();
+    }
+
+    // render thread, once per frame: adopts finished uploads whose fence has signalled, returns
+    // retired ranges to the arena, starts waiting uploads and switches to the requested mesh when
+    // it is resident. Returns true when the mesh to draw, or its place in the arena, changed.
+    bool poll()
+    {
+        bool changed = false;
+        std::vector<Finished> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < finished.size();)
+                if (signalled(finished[i].fence))
+                {
+                    ready.push_back(finished[i]);
+                    finished.erase(finished.begin() + i);
+                }
+                else
+                    ++i;
+        }
+        if (!ready.empty())
+            // rebinding is what makes another context's writes visible to this one
+            glBindBuffer(GL_ARRAY_BUFFER, arena.buffer());
+        for (const Finished &upload : ready)
+        {
+            glDeleteSync(upload.fence);
+            for (size_t i = 0; i < uploading.size(); ++i)
+                if (uploading[i].key == upload.mesh.key)
+                {
+                    uploading.erase(uploading.begin() + i);
+                    break;
+                }
+            // a source that failed leaves the range unwritten; it goes straight back to the arena
+            if (upload.failed)
+            {
+                arena.free(upload.mesh.first, (size_t)upload.mesh.vertices);
+                continue;
+            }
+            if (upload.mesh.bounds)
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, upload.mesh.bounds);
+            resident.push_front(upload.mesh);
+        }
+        for (size_t i = 0; i < retired.size();)
+            if (signalled(retired[i].fence))
+            {
+                glDeleteSync(retired[i].fence);
+                arena.free(retired[i].first, retired[i].vertices);
+                retired.erase(retired.begin() + i);
+            }
+            else
+                ++i;
+        startUploads();
+        changed |= currentMoved;
+        currentMoved = false;
+
+        if (hasWanted && !(current && current->key == wanted))
+        {
+            const GpuMesh *mesh = findResident(wanted);
+            if (mesh)
+            {
+                current = mesh;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    // the mesh to draw from vertexArray(); NULL until the first one is resident, and while one
+    // too big to share the arena with it replaces it
+    const GpuMesh *active() const { return current; }
+    GLuint vertexArray() const { return arena.vertexArray(); }
+    // uploads waiting for space or for their fence (poll again soon)
+    bool pending() const { return !waiting.empty() || !uploading.empty(); }
+    size_t residentBytes() const
+    {
+        size_t total = 0;
+        for (const GpuMesh &mesh : resident)
+            total += mesh.bytes;
+        return total;
+    }
+    const MeshArena &buffer() const { return arena; }
+
+    // render thread; stops the upload thread and deletes the arena
+    void destroy()
+    {
+        if (worker.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                quit = true;
+            }
+            jobAvailable.notify_one();
+            worker.join();
+        }
+        for (Finished &upload : finished)
+        {
+            glDeleteSync(upload.fence);
+            glDeleteBuffers(1, &upload.mesh.bounds);
+        }
+        for (GpuMesh &mesh : resident)
+            glDeleteBuffers(1, &mesh.bounds);
+        for (Retired &range : retired)
+            glDeleteSync(range.fence);
+        finished.clear();
+        retired.clear();
+        resident.clear();
+        uploading.clear();
+        waiting.clear();
+        current = NULL;
+        arena.destroy();
+    }
+
+private:
+    struct Finished
+    {
+        GpuMesh mesh;
+        GLsync fence;
+        bool failed; // the source gave no mesh or one of the wrong size; never adopted
+    };
+    // an evicted mesh's range, free once the frames drawn before the eviction are done
+    struct Retired
+    {
+        size_t first;
+        size_t vertices;
+        GLsync fence;
+    };
+
+    Source source;
+    ContextSwitch contextSwitch;
+    std::function<void()> wakeRenderer;
+    const bool buildBounds;
+
+    // render thread only
+    MeshArena arena;
+    std::list<GpuMesh> resident; // most recently used first
+    const GpuMesh *current = NULL;
+    GpuMeshKey wanted = {0, 0};
+    bool hasWanted = false;
+    bool currentMoved = false; // by a compaction since the last poll()
+    std::deque<GpuMeshKey> waiting;  // requested, no range yet
+    std::vector<GpuMesh> uploading;  // range allocated, not adopted yet
+    std::vector<Retired> retired;
+
+    // shared with the upload thread
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::deque<GpuMesh> jobs;
+    std::vector<Finished> finished;
+    bool quit = false;
+    std::thread worker;
+
+    // A failed wait says nothing about the GPU being done: the range may still be written or read,
+    // so it counts as not signalled and the fence is polled again (reported once, not per frame).
+    static bool signalled(GLsync fence)
+    {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_WAIT_FAILED)
+        {
+            static bool reported = false;
+            if (!reported)
+                std::cout << "ERROR::GPU_MESH_CACHE::WAIT_FAILED: GL error 0x" << std::hex << glGetError() << std::dec
+                          << std::endl;
+            reported = true;
+            return false;
+        }
+        return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+    }
+
+    static size_t verticesFor(const GpuMeshKey &key)
+    {
+        return (size_t)fractalVariants[key.variant].triangles(KochGenerator(key.depth)) * 3;
+    }
+
+    // moves key to the front of the LRU list
+    const GpuMesh *findResident(const GpuMeshKey &key)
+    {
+        for (auto it = resident.begin(); it != resident.end(); ++it)
+            if (it->key == key)
+            {
+                resident.splice(resident.begin(), resident, it);
+                return &resident.front();
+            }
+        return NULL;
+    }
+
+    // gives waiting meshes a range and hands them to the upload thread, evicting and compacting as
+    // needed
+    void startUploads()
+    {
+        while (!waiting.empty())
+        {
+            GpuMeshKey key = waiting.front();
+            size_t vertices = verticesFor(key);
+            if (vertices > arena.ranges().capacity())
+            {
+                std::cout << "ERROR::GPU_MESH_CACHE::OVER_BUDGET: depth " << key.depth << " needs "
+                          << vertices * meshVertexBytes / 1048576.0 << " MB (raise --vram-budget)" << std::endl;
+                waiting.pop_front();
+                continue;
+            }
+            size_t first = 0;
+            if (!arena.allocate(vertices, first))
+            {
+                size_t retiring = 0;
+                for (const Retired &range : retired)
+                    retiring += range.vertices;
+                // evict least recently used meshes until the space would be there
+                while (arena.ranges().freeTotal() + retiring < vertices && evictOne(retiring))
+                    ;
+                // the mesh on screen too, when the new one cannot fit beside it; nothing is drawn
+                // until the new one is resident
+                if (arena.ranges().freeTotal() + retiring < vertices && current)
+                {
+                    for (auto it = resident.begin(); it != resident.end(); ++it)
+                        if (&*it == current)
+                        {
+                            retire(it, retiring);
+                            break;
+                        }
+                    current = NULL;
+                    currentMoved = true;
+                }
+                if (arena.ranges().freeTotal() < vertices)
+                    break; // retired ranges still in use by the GPU; try again next poll
+                if (!uploading.empty() || !retired.empty())
+                    break; // enough space but fragmented; compact once nothing is moving
+                compact();
+                if (!arena.allocate(vertices, first))
+                    break;
+            }
+            waiting.pop_front();
+            GpuMesh mesh = {key, first, (GLsizei)vertices, vertices * meshVertexBytes};
+            uploading.push_back(mesh);
+            if (contextSwitch)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(mesh);
+                jobAvailable.notify_one();
+            }
+            else
+                upload(mesh);
+        }
+    }
+
+    bool evictOne(size_t &retiring)
+    {
+        for (auto it = resident.end(); it != resident.begin();)
+        {
+            --it;
+            if (&*it == current || (hasWanted && it->key == wanted))
+                continue;
+            retire(it, retiring);
+            return true;
+        }
+        return false;
+    }
+
+    void retire(std::list<GpuMesh>::iterator mesh, size_t &retiring)
+    {
+        // fenced here, after every draw that may have used it
+        retired.push_back({mesh->first, (size_t)mesh->vertices, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+        // a fence that never reaches the server never signals to a zero-timeout poll
+        glFlush();
+        retiring += mesh->vertices;
+        // GL keeps the storage alive until the draws using it are done
+        glDeleteBuffers(1, &mesh->bounds);
+        resident.erase(mesh);
+    }
+
+    void compact()
+    {
+        TRACE_SCOPE("mesh arena compact");
+        std::vector<std::pair<size_t *, size_t>> blocks;
+        for (GpuMesh &mesh : resident)
+            blocks.push_back({&mesh.first, (size_t)mesh.vertices});
+        size_t before = current ? current->first : 0;
+        arena.compact(blocks);
+        currentMoved |= current && current->first != before;
+    }
+
+    // writes the mesh into its range, on whichever thread has a context current
+    void upload(const GpuMesh &mesh)
+    {
+        TRACE_SCOPE("mesh upload");
+        // failed until the whole mesh has been written
+        Finished done = {mesh, 0, true};
+        bool called = false;
+        source(mesh.key,
+               [&](const float *vertices, size_t floats, const float *parents)
+               {
+                   called = true;
+                   if (floats != (size_t)mesh.vertices * 6)
+                   {
+                       std::cout << "ERROR::GPU_MESH_CACHE::SIZE_MISMATCH: depth " << mesh.key.depth << " has "
+                                 << floats / 6 << " vertices, expected " << mesh.vertices << std::endl;
+                       return;
+                   }
+                   writeInterleaved(mesh, vertices, floats / 6, parents);
+                   done.failed = false;
+                   if (buildBounds)
+                   {
+                       std::vector<SubtreeBound> bounds = subtreeBounds(vertices, floats / 18, parents);
+                       glGenBuffers(1, &done.mesh.bounds);
+                       glBindBuffer(GL_SHADER_STORAGE_BUFFER, done.mesh.bounds);
+                       glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)(bounds.size() * sizeof(SubtreeBound)),
+                                    bounds.data(), GL_STATIC_DRAW);
+                       done.mesh.subtrees = (GLsizei)bounds.size();
+                   }
+               });
+        if (!called)
+            std::cout << "ERROR::GPU_MESH_CACHE::NO_MESH: depth " << mesh.key.depth << std::endl;
+        done.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // the render context can only see the fence once it has reached the server
+        glFlush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.push_back(done);
+        }
+        if (wakeRenderer)
+            wakeRenderer();
+    }
+
+    // interleaves the parents into the arena layout a slice at a time, so the upload never needs a
+    // second copy of the whole mesh; a vertex without one is its own parent
+    void writeInterleaved(const GpuMesh &mesh, const float *vertices, size_t count, const float *parents)
+    {
+        const size_t sliceVertices = 1 << 16;
+        std::vector<float> slice(std::min(count, sliceVertices) * 9);
+        glBindBuffer(GL_ARRAY_BUFFER, arena.buffer());
+        for (size_t start = 0; start < count; start += sliceVertices)
+        {
+            const size_t n = std::min(sliceVertices, count - start);
+            for (size_t i = 0; i < n; ++i)
+            {
+                const float *vertex = vertices + (start + i) * 6;
+                const float *parent = parents ? parents + (start + i) * 3 : vertex;
+                float *out = &slice[i * 9];
+                std::memcpy(out, vertex, 6 * sizeof(float));
+                std::memcpy(out + 6, parent, 3 * sizeof(float));
+            }
+            glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)((mesh.first + start) * meshVertexBytes),
+                            (GLsizeiptr)(n * meshVertexBytes), slice.data());
+        }
+    }
+
+    void uploadLoop()
+    {
+        Trace::setThreadName("mesh upload");
+        contextSwitch(true);
+        while (true)
+        {
+            GpuMesh mesh;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAvailable.wait(lock, [this] { return quit || !jobs.empty(); });
+                if (quit)
+                    break;
+                mesh = jobs.front();
+                jobs.pop_front();
+            }
+            upload(mesh);
+        }
+        contextSwitch(false);
+    }
+};
+#endif
@@ -0,0 +1,337 @@
+#ifndef KOCH_GENERATOR_H
+#define KOCH_GENERATOR_H
+
+#include <cmath>
+#include <vector>
+#include <string>
+#include <thread>
+
+#include "trace.h"
+
+const unsigned int defaultDepth = 3; // change this to either save or set fire to your computer
+
+inline std::vector<float> crossProduct(const std::vector<float> &a, const std::vector<float> &b)
+{
+    return {
+        a[1] * b[2] - a[2] * b[1],
+        a[2] * b[0] - a[0] * b[2],
+        a[0] * b[1] - a[1] * b[0]};
+}
+
+inline std::vector<float> pointsVector(const std::vector<float> &a, const std::vector<float> &b)
+{
+    std::vector<float> ab(a.size());
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        ab[i] = b[i] - a[i];
+    }
+    return ab;
+}
+
+inline std::vector<float> normalize(const std::vector<float> &v)
+{
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length == 0.0f)
+        return {0.0f, 0.0f, 0.0f};
+    return {v[0] / length, v[1] / length, v[2] / length};
+}
+
+inline std::vector<float> normal(const std::vector<float> &a, const std::vector<float> &b, const std::vector<float> &c)
+{
+    std::vector<float> ab = pointsVector(a, b);
+    std::vector<float> ac = pointsVector(a, c);
+    return normalize(crossProduct(ab, ac));
+}
+
+inline std::vector<float> midpoint(std::vector<float> c1, std::vector<float> c2)
+{
+    float x = (c1[0] + c2[0]) / 2;
+    float y = (c1[1] + c2[1]) / 2;
+    float z = (c1[2] + c2[2]) / 2;
+    std::vector<float> midpoint;
+    midpoint.insert(midpoint.end(), x);
+    midpoint.insert(midpoint.end(), y);
+    midpoint.insert(midpoint.end(), z);
+    return midpoint;
+}
+
+inline bool vectorEquals(const std::vector<float> &v1, const std::vector<float> &v2)
+{
+    if (v1.size() != v2.size())
+        return false;
+    for (size_t i = 0; i < v1.size(); ++i)
+    {
+        if (std::abs(v1[i] - v2[i]) > 1e-1)
+            return false;
+    }
+    return true;
+}
+
+inline bool normalsEqual(const std::vector<float> &n1, const std::vector<float> &n2, float epsilon = 1e-1)
+{
+    float dot = n1[0] * n2[0] + n1[1] * n2[1] + n1[2] * n2[2];
+    return std::abs(std::abs(dot) - 1.0f) < epsilon;
+}
+
+// Number of triangles a depth-maxDepth mesh has: every level below the limit replaces a triangle
+// with six (three apex faces plus three corners), so each face contributes 6^depth.
+inline unsigned long long triangleCount(unsigned int maxDepth)
+{
+    unsigned long long count = 4;
+    for (unsigned int i = 0; i < maxDepth; ++i)
+        count *= 6;
+    return count;
+}
+
+// everything a generation depends on; the defaults are the classic four-colour Koch tetrahedron
+struct KochConfig
+{
+    unsigned int depth = defaultDepth;
+    // base tetrahedron, one triangle per face
+    std::vector<float> faces[4][3] = {
+        {{.5f, .5f, .5f}, {-.5f, -.5f, .5f}, {.5f, -.5f, -.5f}},
+        {{.5f, .5f, .5f}, {.5f, -.5f, -.5f}, {-.5f, .5f, -.5f}},
+        {{.5f, .5f, .5f}, {-.5f, .5f, -.5f}, {-.5f, -.5f, .5f}},
+        {{-.5f, -.5f, .5f}, {-.5f, .5f, -.5f}, {.5f, -.5f, -.5f}}};
+    // colour of each base face, given to every triangle that faces the same way
+    std::vector<float> palette[4] = {
+        {1.0f, 0.0f, 0.0f},  // red
+        {0.0f, 1.0f, 0.0f},  // green
+        {0.0f, 0.0f, 1.0f},  // blue
+        {1.0f, 1.0f, 0.0f}}; // yellow
+    // apex height over the edge of the midpoint triangle; sqrt(2/3) makes regular tetrahedra
+    float apexHeightRatio = std::sqrt(2.0f / 3.0f);
+    // levels at which the corner triangles are subdivided again; past it they stay single flat
+    // triangles. Unlimited is the classic rule (corners recurse until the level above the limit)
+    unsigned int cornerLevels = ~0u;
+};
+
+// Generates the fractal for one KochConfig. All methods are const and the object holds no
+// mutable state, so any number of generators (different depths for LOD, different shapes) can
+// run at the same time on different threads without locking.
+class KochGenerator
+{
+public:
+    explicit KochGenerator(const KochConfig &config = KochConfig()) : settings(config)
+    {
+        for (int i = 0; i < 4; ++i)
+            faceNormals[i] = normal(settings.faces[i][0], settings.faces[i][1], settings.faces[i][2]);
+    }
+    // the default shape at another depth
+    explicit KochGenerator(unsigned int depth) : KochGenerator(withDepth(depth)) {}
+
+    const KochConfig &config() const { return settings; }
+    unsigned int depth() const { return settings.depth; }
+    unsigned long long triangles() const { return 4 * subtreeTriangles(0); }
+
+    // whether drawKT at this depth recurses into the three corner triangles
+    bool recursesCorners(int depth) const
+    {
+        return depth < (int)settings.depth - 1 && (unsigned int)depth < settings.cornerLevels;
+    }
+
+    // triangles one drawKT call at depth emits; 6^(maxDepth - depth) with the classic corner rule
+    unsigned long long subtreeTriangles(int depth) const
+    {
+        unsigned long long count = 1;
+        for (int d = (int)settings.depth - 1; d >= depth; --d)
+            count = 3 * count + (recursesCorners(d) ? 3 * count : 3);
+        return count;
+    }
+
+    // normal/colour classification: the base face whose normal is closest (up to sign) to the triangle's
+    int classifyFace(const std::vector<float> &a, const std::vector<float> &b, const std::vector<float> &c) const
+    {
+        std::vector<float> n = normal(a, b, c);
+
+        float maxDot = -1.0f;
+        int bestFace = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            float dot = std::abs(n[0] * faceNormals[i][0] + n[1] * faceNormals[i][1] + n[2] * faceNormals[i][2]);
+            if (dot > maxDot)
+            {
+                maxDot = dot;
+                bestFace = i;
+            }
+        }
+        return bestFace;
+    }
+
+    void drawTriangle(const std::vector<float> &a, const std::vector<float> &b, const std::vector<float> &c,
+                      std::vector<float> &vertices) const
+    {
+        const std::vector<float> &color = settings.palette[classifyFace(a, b, c)];
+        vertices.insert(vertices.end(), a.begin(), a.end());
+        vertices.insert(vertices.end(), color.begin(), color.end());
+        vertices.insert(vertices.end(), b.begin(), b.end());
+        vertices.insert(vertices.end(), color.begin(), color.end());
+        vertices.insert(vertices.end(), c.begin(), c.end());
+        vertices.insert(vertices.end(), color.begin(), color.end());
+    }
+
+    // one subdivision step: the edge midpoints and the apex raised over their centroid
+    void subdivide(const std::vector<float> &a, const std::vector<float> &b, const std::vector<float> &c,
+                   std::vector<float> &mid1, std::vector<float> &mid2, std::vector<float> &mid3,
+                   std::vector<float> &apex) const
+    {
+        mid1 = midpoint(c, a);
+        mid2 = midpoint(a, b);
+        mid3 = midpoint(b, c);
+
+        std::vector<float> baseNormal = normal(mid1, mid2, mid3);
+
+        float edgeLength = std::sqrt(
+            (mid1[0] - mid2[0]) * (mid1[0] - mid2[0]) +
+            (mid1[1] - mid2[1]) * (mid1[1] - mid2[1]) +
+            (mid1[2] - mid2[2]) * (mid1[2] - mid2[2]));
+        float height = settings.apexHeightRatio * edgeLength;
+
+        std::vector<float> centroid = {
+            (mid1[0] + mid2[0] + mid3[0]) / 3.0f,
+            (mid1[1] + mid2[1] + mid3[1]) / 3.0f,
+            (mid1[2] + mid2[2] + mid3[2]) / 3.0f};
+
+        apex = {
+            centroid[0] + baseNormal[0] * height,
+            centroid[1] + baseNormal[1] * height,
+            centroid[2] + baseNormal[2] * height};
+    }
+
+    void drawKT(const std::vector<float> &a, const std::vector<float> &b, const std::vector<float> &c, int depth,
+                std::vector<float> &vertices) const
+    {
+        const int maxDepth = (int)settings.depth;
+        if (depth < maxDepth)
+        {
+            std::vector<float> mid1, mid2, mid3, newC1;
+            subdivide(a, b, c, mid1, mid2, mid3, newC1);
+
+            drawKT(mid1, mid2, newC1, depth + 1, vertices);
+            drawKT(mid2, mid3, newC1, depth + 1, vertices);
+            drawKT(mid3, mid1, newC1, depth + 1, vertices);
+
+            if (recursesCorners(depth))
+            {
+                drawKT(a, mid2, mid1, depth + 1, vertices);
+                drawKT(b, mid3, mid2, depth + 1, vertices);
+                drawKT(c, mid1, mid3, depth + 1, vertices);
+            }
+            else
+            {
+                drawTriangle(mid2, mid1, a, vertices);
+                drawTriangle(mid3, mid2, b, vertices);
+                drawTriangle(mid1, mid3, c, vertices);
+            }
+            //drawTriangle(mid1, mid2, mid3, vertices);
+        }
+        else
+        {
+            drawTriangle(a, b, c, vertices);
+        }
+    }
+
+    // the whole fractal: one drawKT per face of the base tetrahedron
+    std::vector<float> generate() const
+    {
+        TRACE_SCOPE("generate");
+        std::vector<float> vertices;
+        static const char *const labels[4] = {"face 1", "face 2", "face 3", "face 4"};
+        for (int i = 0; i < 4; ++i)
+        {
+            TRACE_SCOPE(labels[i]);
+            drawKT(settings.faces[i][0], settings.faces[i][1], settings.faces[i][2], 0, vertices);
+        }
+        return vertices;
+    }
+
+    // same output as generate(), with the four faces generated on their own threads and
+    // concatenated in face order afterwards
+    std::vector<float> generateParallel() const
+    {
+        TRACE_SCOPE("generate parallel");
+        std::vector<float> parts[4];
+        std::thread workers[4];
+        for (int i = 0; i < 4; ++i)
+            workers[i] = std::thread([this, &parts, i]
+                                     {
+                                         Trace::setThreadName("generator worker");
+                                         TRACE_SCOPE("face task");
+                                         drawKT(settings.faces[i][0], settings.faces[i][1], settings.faces[i][2], 0,
+                                                parts[i]);
+                                     });
+        for (std::thread &worker : workers)
+            worker.join();
+
+        TRACE_SCOPE("concatenate");
+        std::vector<float> vertices;
+        vertices.reserve(triangles() * 18);
+        for (const std::vector<float> &part : parts)
+            vertices.insert(vertices.end(), part.begin(), part.end());
+        return vertices;
+    }
+
+    // Runs classifyFace over every triangle of an already generated mesh, exactly as drawTriangle
+    // calls it. Used to measure the classification step on its own; returns a checksum of the
+    // chosen faces so the work cannot be optimised away.
+    unsigned long long classifyMesh(const std::vector<float> &vertices) const
+    {
+        unsigned long long checksum = 0;
+        for (size_t i = 0; i + 18 <= vertices.size(); i += 18)
+        {
+            std::vector<float> a(vertices.begin() + i, vertices.begin() + i + 3);
+            std::vector<float> b(vertices.begin() + i + 6, vertices.begin() + i + 9);
+            std::vector<float> c(vertices.begin() + i + 12, vertices.begin() + i + 15);
+            checksum = checksum * 5 + classifyFace(a, b, c);
+        }
+        return checksum;
+    }
+
+private:
+    KochConfig settings;
+    std::vector<float> faceNormals[4];
+
+    static KochConfig withDepth(unsigned int depth)
+    {
+        KochConfig config;
+        config.depth = depth;
+        return config;
+    }
+};
+
+// the default shape at maxDepth, for callers that only choose the depth
+inline std::vector<float> generateMesh(unsigned int maxDepth)
+{
+    return KochGenerator(maxDepth).generate();
+}
+
+inline std::vector<float> generateMeshParallel(unsigned int maxDepth)
+{
+    return KochGenerator(maxDepth).generateParallel();
+}
+
+// the compiled "koch" rule set of fractal_rules.h, defined there
+inline std::vector<float> generateKochKernel(const KochGenerator &generator);
+
+// generator implementations selectable by name from the benchmarks and command line
+struct GeneratorEngine
+{
+    const char *name;
+    std::vector<float> (*generate)(const KochGenerator &generator);
+};
+const GeneratorEngine generatorEngines[] = {
+    {"reference", [](const KochGenerator &generator) { return generator.generate(); }},
+    {"parallel", [](const KochGenerator &generator) { return generator.generateParallel(); }},
+    {"kernel", generateKochKernel}};
+const int generatorEngineCount = sizeof(generatorEngines) / sizeof(generatorEngines[0]);
+
+inline const GeneratorEngine *findGeneratorEngine(const char *name)
+{
+    for (const GeneratorEngine &engine : generatorEngines)
+        if (std::string(engine.name) == name)
+            return &engine;
+    return NULL;
+}
+
+#include "fractal_rules.h"
+#endif
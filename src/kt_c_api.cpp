@@ -0,0 +1,103 @@
+// The C interface of kt_c_api.h over the compiled koch rules (KochKernel in fractal_rules.h) and
+// the subtree planner. No exception may leave these functions.
+
+#define KT_BUILDING_LIBRARY
+#include "kt_c_api.h"
+
+#include "koch_generator.h"
+#include "fractal_rules.h"
+#include "subtree_plan.h"
+
+#include <vector>
+
+extern "C" {
+
+KT_API int kt_api_version(void)
+{
+    return 1;
+}
+
+KT_API uint64_t kt_count(unsigned int depth)
+{
+    return depth <= KT_MAX_DEPTH ? triangleCount(depth) : 0;
+}
+
+KT_API int64_t kt_generate(unsigned int depth, float *out, size_t cap)
+{
+    if (depth > KT_MAX_DEPTH)
+        return KT_ERROR_DEPTH;
+    const uint64_t floats = kt_count(depth) * KT_FLOATS_PER_TRIANGLE;
+    if (!out || cap < floats)
+        return KT_ERROR_BUFFER_TOO_SMALL;
+    try
+    {
+        const KochGenerator generator(depth);
+        return KochKernel::generateInto(generator, out) - out;
+    }
+    catch (...)
+    {
+        return KT_ERROR_INTERNAL;
+    }
+}
+
+KT_API int64_t kt_generate_chunked(unsigned int depth, float *buffer, size_t cap, kt_chunk_callback callback,
+                                   void *user)
+{
+    if (depth > KT_MAX_DEPTH)
+        return KT_ERROR_DEPTH;
+    const unsigned long long maxTriangles = cap / KT_FLOATS_PER_TRIANGLE;
+    if (!buffer || !callback || maxTriangles == 0)
+        return KT_ERROR_BUFFER_TOO_SMALL;
+    try
+    {
+        // subtrees no larger than the buffer, packed into it in emission order
+        const KochGenerator generator(depth);
+        const std::vector<SubtreeTask> tasks = planSubtrees(generator, splitDepthFor(depth, maxTriangles));
+        FractalContext context(generator, buffer);
+        unsigned long long chunkFirst = 0;
+        for (const SubtreeTask &task : tasks)
+        {
+            size_t filled = (size_t)(context.cursor - buffer) / KT_FLOATS_PER_TRIANGLE;
+            if (filled > 0 && filled + task.triangles > maxTriangles)
+            {
+                if (callback(user, buffer, filled, chunkFirst) != 0)
+                    return KT_ERROR_STOPPED;
+                context.cursor = buffer;
+                filled = 0;
+            }
+            if (filled == 0)
+                chunkFirst = task.firstTriangle;
+            // the face index only feeds BaseFaceColor, which the koch rules do not use
+            if (task.leaf)
+                KochKernel::leaf(context, toVec3f(task.a), toVec3f(task.b), toVec3f(task.c), 0);
+            else
+                KochKernel::draw(context, toVec3f(task.a), toVec3f(task.b), toVec3f(task.c), task.depth, 0);
+        }
+        size_t filled = (size_t)(context.cursor - buffer) / KT_FLOATS_PER_TRIANGLE;
+        if (filled > 0 && callback(user, buffer, filled, chunkFirst) != 0)
+            return KT_ERROR_STOPPED;
+        return (int64_t)generator.triangles();
+    }
+    catch (...)
+    {
+        return KT_ERROR_INTERNAL;
+    }
+}
+
+KT_API const char *kt_error_string(int64_t error)
+{
+    switch (error)
+    {
+    case KT_ERROR_DEPTH:
+        return "depth above KT_MAX_DEPTH";
+    case KT_ERROR_BUFFER_TOO_SMALL:
+        return "buffer too small";
+    case KT_ERROR_STOPPED:
+        return "stopped by the chunk callback";
+    case KT_ERROR_INTERNAL:
+        return "internal error";
+    default:
+        return error >= 0 ? "ok" : "unknown error";
+    }
+}
+}
@@ -0,0 +1,69 @@
+#ifndef KT_C_API_H
+#define KT_C_API_H
+
+/* C interface to the Koch tetrahedron generator, for tools outside the viewer (C, Python through
+ * ctypes/cffi, anything with a C FFI). Build it as a shared library:
+ *
+ *   g++ -std=c++17 -O2 -fPIC -shared -fvisibility=hidden -pthread -Isrc src/kt_c_api.cpp -o libkt.so
+ *
+ * The mesh is written straight into memory the caller owns (a numpy array, a mapped GPU buffer),
+ * as interleaved float32 x y z r g b, three vertices per triangle; the same layout the viewer
+ * uploads. Nothing is allocated for the vertex data on the library side.
+ *
+ * Every function is reentrant and may be called from several threads at once. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(KT_BUILDING_LIBRARY)
+#define KT_API __declspec(dllexport)
+#else
+#define KT_API __declspec(dllimport)
+#endif
+#else
+#define KT_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KT_FLOATS_PER_TRIANGLE 18
+#define KT_MAX_DEPTH 12
+
+/* error codes, all negative */
+#define KT_ERROR_DEPTH -1            /* depth above KT_MAX_DEPTH */
+#define KT_ERROR_BUFFER_TOO_SMALL -2 /* cap below what the call needs */
+#define KT_ERROR_STOPPED -3          /* the chunk callback returned nonzero */
+#define KT_ERROR_INTERNAL -4         /* out of memory for the subtree plan, or any other failure */
+
+/* version of this interface; bumped only on incompatible changes */
+KT_API int kt_api_version(void);
+
+/* triangles a depth-`depth` mesh has (4 * 6^depth), 0 above KT_MAX_DEPTH. The whole mesh needs
+ * kt_count(depth) * KT_FLOATS_PER_TRIANGLE floats. */
+KT_API uint64_t kt_count(unsigned int depth);
+
+/* Writes the whole mesh to out, which holds cap floats. Returns the number of floats written, or
+ * a negative KT_ERROR_* (out is untouched when the buffer is too small). */
+KT_API int64_t kt_generate(unsigned int depth, float *out, size_t cap);
+
+/* Receives one chunk: `triangles` triangles starting at triangle `first_triangle` of the mesh.
+ * vertices points into the caller's buffer and is overwritten by the next chunk. Return 0 to
+ * continue, anything else to stop. */
+typedef int (*kt_chunk_callback)(void *user, const float *vertices, size_t triangles, uint64_t first_triangle);
+
+/* Generates the mesh in order, in chunks that fill at most cap floats of buffer, and hands each
+ * one to callback. Any cap of at least KT_FLOATS_PER_TRIANGLE works; larger buffers mean fewer
+ * and bigger chunks. Returns the total number of triangles, or a negative KT_ERROR_*. */
+KT_API int64_t kt_generate_chunked(unsigned int depth, float *buffer, size_t cap, kt_chunk_callback callback,
+                                   void *user);
+
+/* a static description of a KT_ERROR_* code */
+KT_API const char *kt_error_string(int64_t error);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
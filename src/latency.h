@@ -0,0 +1,240 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+// Input-to-photon latency instrumentation.
+//
+// The input thread stamps every input event with a sequence number and a CPU timestamp
+// (recordInput). The newest sequence number travels to the render thread inside the frame
+// snapshot; each frame therefore "first uses" every event between the previous frame's
+// sequence and its own. Right after glfwSwapBuffers the render thread drops a GL_TIMESTAMP
+// query into the command stream, which resolves once the GPU has finished that frame's work
+// up to the swap. GPU timestamps are mapped onto the CPU clock through an offset measured with
+// glGetInteger64v(GL_TIMESTAMP), refreshed every few seconds to absorb drift. Queries are only
+// polled, never waited on, except when flushing at exit.
+class LatencyTracker
+{
+public:
+    // clock is the CPU time source shared by both threads (glfwGetTime), in seconds
+    explicit LatencyTracker(double (*clock)()) : clock(clock) {}
+
+    bool enabled = false;
+    std::string csvPath;
+
+    // input thread ------------------------------------------------------------------
+    // stamps one event and returns its sequence number
+    uint64_t recordInput()
+    {
+        if (!enabled)
+            return 0;
+        uint64_t sequence = nextSequence.load(std::memory_order_relaxed) + 1;
+        Event &event = events[sequence % EVENT_RING];
+        event.sequence.store(sequence, std::memory_order_relaxed);
+        event.time.store(clock(), std::memory_order_relaxed);
+        nextSequence.store(sequence, std::memory_order_release);
+        return sequence;
+    }
+
+    // the newest sequence number; published with the frame state
+    uint64_t latestSequence() const { return nextSequence.load(std::memory_order_acquire); }
+
+    // render thread -----------------------------------------------------------------
+    // call after glfwSwapBuffers with the sequence number the frame was built from
+    void frameSubmitted(uint64_t inputSequence)
+    {
+        if (!enabled || inputSequence <= lastFrameSequence)
+        {
+            collect(false);
+            return;
+        }
+        if (lastCalibration < 0.0 || clock() - lastCalibration > CALIBRATION_INTERVAL)
+            calibrate();
+
+        PendingFrame frame;
+        frame.firstSequence = lastFrameSequence + 1;
+        frame.lastSequence = inputSequence;
+        frame.frame = frameCounter++;
+        frame.gpuToCpuOffset = gpuToCpuOffset;
+        // gather the event timestamps now, before the ring can wrap around them
+        for (uint64_t sequence = frame.firstSequence; sequence <= frame.lastSequence; ++sequence)
+        {
+            const Event &event = events[sequence % EVENT_RING];
+            if (event.sequence.load(std::memory_order_relaxed) != sequence)
+            {
+                ++droppedEvents;
+                continue;
+            }
+            frame.inputTimes.push_back({sequence, event.time.load(std::memory_order_relaxed)});
+        }
+        lastFrameSequence = inputSequence;
+
+        frame.query = acquireQuery();
+        glQueryCounter(frame.query, GL_TIMESTAMP);
+        pending.push_back(std::move(frame));
+        collect(false);
+    }
+
+    // resolves finished timestamp queries; with wait the remaining ones are waited on
+    void collect(bool wait)
+    {
+        while (!pending.empty())
+        {
+            PendingFrame &frame = pending.front();
+            if (!wait)
+            {
+                GLint available = 0;
+                glGetQueryObjectiv(frame.query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    return;
+            }
+            GLuint64 gpuTime = 0;
+            glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &gpuTime);
+            double photonTime = gpuTime * 1e-9 + frame.gpuToCpuOffset;
+            for (const auto &input : frame.inputTimes)
+            {
+                Sample sample{input.first, frame.frame, input.second, photonTime};
+                samples.push_back(sample);
+            }
+            freeQueries.push_back(frame.query);
+            pending.pop_front();
+        }
+    }
+
+    // p50/p99 over everything measured so far
+    void report(std::ostream &out) const
+    {
+        if (!enabled)
+            return;
+        std::vector<double> latencies;
+        latencies.reserve(samples.size());
+        for (const Sample &sample : samples)
+            latencies.push_back((sample.photonTime - sample.inputTime) * 1000.0);
+        if (latencies.empty())
+        {
+            out << "latency: no input events measured" << std::endl;
+            return;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        out << "latency: " << latencies.size() << " events"
+            << ", p50 " << percentile(latencies, 0.50) << " ms"
+            << ", p99 " << percentile(latencies, 0.99) << " ms"
+            << ", max " << latencies.back() << " ms";
+        if (droppedEvents)
+            out << " (" << droppedEvents << " events overwritten before a frame used them)";
+        out << std::endl;
+    }
+
+    void writeCsv() const
+    {
+        if (!enabled || csvPath.empty())
+            return;
+        std::ofstream file(csvPath, std::ios::trunc);
+        if (!file)
+        {
+            std::cout << "ERROR::LATENCY::CANNOT_WRITE: " << csvPath << std::endl;
+            return;
+        }
+        file << "sequence,frame,input_time_s,photon_time_s,latency_ms\n";
+        char line[128];
+        for (const Sample &sample : samples)
+        {
+            std::snprintf(line, sizeof(line), "%llu,%llu,%.6f,%.6f,%.3f\n",
+                          (unsigned long long)sample.sequence, (unsigned long long)sample.frame,
+                          sample.inputTime, sample.photonTime,
+                          (sample.photonTime - sample.inputTime) * 1000.0);
+            file << line;
+        }
+        std::cout << "latency samples written to " << csvPath << std::endl;
+    }
+
+    // render thread, with the context still current
+    void destroy()
+    {
+        if (!enabled)
+            return;
+        collect(true);
+        if (!freeQueries.empty())
+            glDeleteQueries((GLsizei)freeQueries.size(), freeQueries.data());
+        freeQueries.clear();
+    }
+
+private:
+    static const size_t EVENT_RING = 1 << 14;
+    static constexpr double CALIBRATION_INTERVAL = 5.0;
+
+    struct Event
+    {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<double> time{0.0};
+    };
+    struct PendingFrame
+    {
+        uint64_t firstSequence = 0, lastSequence = 0, frame = 0;
+        double gpuToCpuOffset = 0.0;
+        GLuint query = 0;
+        std::vector<std::pair<uint64_t, double>> inputTimes;
+    };
+    struct Sample
+    {
+        uint64_t sequence;
+        uint64_t frame;
+        double inputTime;
+        double photonTime;
+    };
+
+    double (*clock)();
+    Event events[EVENT_RING];
+    std::atomic<uint64_t> nextSequence{0};
+
+    // render-thread state
+    uint64_t lastFrameSequence = 0;
+    uint64_t frameCounter = 0;
+    uint64_t droppedEvents = 0;
+    double gpuToCpuOffset = 0.0;
+    double lastCalibration = -1.0;
+    std::deque<PendingFrame> pending;
+    std::vector<GLuint> freeQueries;
+    std::vector<Sample> samples;
+
+    // bracket the GPU clock read with two CPU reads and take the midpoint
+    void calibrate()
+    {
+        double before = clock();
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        double after = clock();
+        gpuToCpuOffset = (before + after) * 0.5 - gpuNow * 1e-9;
+        lastCalibration = after;
+    }
+
+    GLuint acquireQuery()
+    {
+        if (freeQueries.empty())
+        {
+            GLuint query = 0;
+            glGenQueries(1, &query);
+            return query;
+        }
+        GLuint query = freeQueries.back();
+        freeQueries.pop_back();
+        return query;
+    }
+
+    static double percentile(const std::vector<double> &sorted, double p)
+    {
+        size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+};
+#endif
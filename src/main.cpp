@@ -5,12 +5,28 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include "shader_s.h"
 #include "camera.h"
+#include "koch_generator.h"
+#include "renderer.h"
+#include "snapshot.h"
+#include "latency.h"
+#include "benchmark.h"
+#include "generate_cli.h"
+#include "sweep.h"
+#include "kt_c_api.h"
+#include "mesh_cache.h"
+#include "gpu_mesh_cache.h"
+#include "perf_counters.h"
+#include "trace.h"
 
 #include <iostream>
 #include <cmath>
 #include <vector>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -36,329 +52,511 @@ float preRotY;
 
 float totalRotX, totalRotY;
 
+int renderMode = 0;
+
 // timing
 float deltaTime = 0.0f;	// time between current frame and last frame
 float lastFrame = 0.0f;
 
-const std::vector<float> color1 = {1.0f, 0.0f, 0.0f}; // red
-const std::vector<float> color2 = {0.0f, 1.0f, 0.0f}; // green
-const std::vector<float> color3 = {0.0f, 0.0f, 1.0f}; // blue
-const std::vector<float> color4 = {1.0f, 1.0f, 0.0f}; // yellow
-
-const unsigned int maxDepth = 3; // change this to either save or set fire to your computer
-
-// Face 1
-const std::vector<float> f1vertex1 = {.5f, .5f, .5f};
-const std::vector<float> f1vertex2 = {-.5f, -.5f, .5f};
-const std::vector<float> f1vertex3 = {.5f, -.5f, -.5f};
-
-// Face 2
-const std::vector<float> f2vertex1 = {.5f, .5f, .5f};
-const std::vector<float> f2vertex2 = {.5f, -.5f, -.5f};
-const std::vector<float> f2vertex3 = {-.5f, .5f, -.5f};
-
-// Face 3
-const std::vector<float> f3vertex1 = {.5f, .5f, .5f};
-const std::vector<float> f3vertex2 = {-.5f, .5f, -.5f};
-const std::vector<float> f3vertex3 = {-.5f, -.5f, .5f};
+// on-demand rendering: frames are only drawn while something changed, unless continuous
+// rendering is switched on (--continuous or C) for benchmarking
+bool sceneDirty = true;
+bool continuousRendering = false;
+const double idleWaitTimeout = 0.25;     // seconds glfwWaitEventsTimeout may sleep while idle
+const double inputSampleInterval = 0.001; // seconds between input samples while a movement key is held
+
+// threading: the main thread owns GLFW events, the camera and the rotation state, and publishes
+// what a frame needs as a FrameState; the render thread owns the GL context and always draws the
+// newest published state, so input sampling never waits on glfwSwapBuffers
+Snapshot<FrameState> frameSnapshot;
+int framebufferWidth = SCR_WIDTH, framebufferHeight = SCR_HEIGHT;
+
+// only used to park the render thread while idle; the state itself travels lock-free
+std::mutex renderWakeMutex;
+std::condition_variable renderWake;
+bool renderWakePending = false;
+bool renderQuit = false;
+
+// input-to-photon latency measurement, enabled with --latency[=file.csv]
+LatencyTracker latency(glfwGetTime);
+
+// frame profiler (render thread), enabled with --profile[=file.json|file.csv] or by the overlay (O).
+// P dumps the percentiles (and starts collecting if nothing was); collected data is written again on exit
+bool profiling = false;
+bool showOverlay = false;
+unsigned int profileDumpRequests = 0;
+std::string profilePath = "profile.json";
+
+// Chrome trace-event export of startup and per-frame phases (--trace[=trace.json])
+std::string tracePath;
+
+// generated meshes are kept in mesh_cache/ and mapped on later launches (--no-mesh-cache to skip)
+bool useMeshCache = true;
+
+// mesh shown: depth ([ and ]) and fractal rule set (V, or --variant=koch|anti-koch|sierpinski)
+unsigned int meshDepth = defaultDepth;
+int meshVariant = 0;
+const unsigned int maxViewerDepth = 7; // 80 MB of vertices, 120 MB in VRAM with parents; depth 8 would be 6x that
+
+// meshes of recently shown depths stay in VRAM up to this many bytes (--vram-budget=MB)
+size_t vramBudget = 256u << 20;
+// hidden window whose context shares objects with the main one; mesh uploads run on it
+GLFWwindow *uploadWindow = NULL;
+
+// subtrees are frustum and size culled on the GPU and drawn with one indirect multi-draw, on
+// GL 4.3 contexts (--no-gpu-cull to draw meshes whole); subtrees smaller than cullPixels across
+// are skipped (--cull-pixels=N)
+bool gpuCulling = true;
+float cullPixels = 1.0f;
+
+// one-level depth changes geomorph over this long instead of popping (--morph-seconds=S, 0 to pop)
+float morphSeconds = 0.4f;
+
+// hardware counters around loading the starting mesh and writing it into the GPU cache (--perf, Linux)
+bool perfCounters = false;
+double inputSeconds = 0.0;
 
-// Face 4
-const std::vector<float> f4vertex1 = {-.5f, -.5f, .5f};
-const std::vector<float> f4vertex2 = {-.5f, .5f, -.5f};
-const std::vector<float> f4vertex3 = {.5f, -.5f, -.5f};
-
-std::vector<float> crossProduct(const std::vector<float> &a, const std::vector<float> &b)
-{
-    return {
-        a[1] * b[2] - a[2] * b[1],
-        a[2] * b[0] - a[0] * b[2],
-        a[0] * b[1] - a[1] * b[0]};
-}
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void mouse_callback(GLFWwindow* window, double xpos, double ypos);
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+bool processInput(GLFWwindow *window);
+void window_refresh_callback(GLFWwindow *window);
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
+void publishFrameState();
+void renderLoop(GLFWwindow *window);
+void loadMesh(const GpuMeshKey &key, const GpuMeshCache::Upload &upload);
 
-std::vector<float> pointsVector(const std::vector<float> &a, const std::vector<float> &b)
+int main(int argc, char **argv)
 {
-    std::vector<float> ab(a.size());
-    for (size_t i = 0; i < a.size(); ++i)
+    if (argc > 1 && std::strcmp(argv[1], "benchmark") == 0)
     {
-        ab[i] = b[i] - a[i];
+        BenchmarkOptions options;
+        if (!parseBenchmarkArgs(argc - 2, argv + 2, options))
+            return -1;
+        return runBenchmark(options, generateMesh);
     }
-    return ab;
-}
-
-std::vector<float> normalize(const std::vector<float> &v)
-{
-    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
-    if (length == 0.0f)
-        return {0.0f, 0.0f, 0.0f};
-    return {v[0] / length, v[1] / length, v[2] / length};
-}
-
-std::vector<float> normal(const std::vector<float> &a, const std::vector<float> &b, const std::vector<float> &c)
-{
-    std::vector<float> ab = pointsVector(a, b);
-    std::vector<float> ac = pointsVector(a, c);
-    return normalize(crossProduct(ab, ac));
-}
-
-std::vector<float> midpoint(std::vector<float> c1, std::vector<float> c2)
-{
-    float x = (c1[0] + c2[0]) / 2;
-    float y = (c1[1] + c2[1]) / 2;
-    float z = (c1[2] + c2[2]) / 2;
-    std::vector<float> midpoint;
-    midpoint.insert(midpoint.end(), x);
-    midpoint.insert(midpoint.end(), y);
-    midpoint.insert(midpoint.end(), z);
-    return midpoint;
-}
-
-bool vectorEquals(const std::vector<float> &v1, const std::vector<float> &v2)
-{
-    if (v1.size() != v2.size())
-        return false;
-    for (size_t i = 0; i < v1.size(); ++i)
+    // headless generation: nothing below this (GLFW, GL, the render thread) is touched
+    if (argc > 1 && std::strcmp(argv[1], "generate") == 0)
     {
-        if (std::abs(v1[i] - v2[i]) > 1e-1)
-            return false;
+        GenerateOptions options;
+        if (!parseGenerateArgs(argc - 2, argv + 2, options))
+            return -1;
+        return runGenerate(options);
     }
-    return true;
-}
-
-bool normalsEqual(const std::vector<float> &n1, const std::vector<float> &n2, float epsilon = 1e-1)
-{
-    float dot = n1[0] * n2[0] + n1[1] * n2[1] + n1[2] * n2[2];
-    return std::abs(std::abs(dot) - 1.0f) < epsilon;
-}
-
-const std::vector<float> normal1 = normal(f1vertex1, f1vertex2, f1vertex3);
-const std::vector<float> normal2 = normal(f2vertex1, f2vertex2, f2vertex3);
-const std::vector<float> normal3 = normal(f3vertex1, f3vertex2, f3vertex3);
-const std::vector<float> normal4 = normal(f4vertex1, f4vertex2, f4vertex3);
-
-void drawTriangle(std::vector<float> a, std::vector<float> b, std::vector<float> c, std::vector<float> &vertices)
-{
-    std::vector<float> n = normal(a, b, c);
-
-    const std::vector<std::vector<float>> faceNormals = {normal1, normal2, normal3, normal4};
-    const std::vector<std::vector<float>> faceColors = {color1, color2, color3, color4};
-
-    float maxDot = -1.0f;
-    int bestFace = 0;
-    for (int i = 0; i < 4; ++i)
+    if (argc > 1 && std::strcmp(argv[1], "merge") == 0)
+        return runMerge(argc - 2, argv + 2);
+    if (argc > 1 && std::strcmp(argv[1], "sweep") == 0)
     {
-        float dot = std::abs(n[0] * faceNormals[i][0] + n[1] * faceNormals[i][1] + n[2] * faceNormals[i][2]);
-        if (dot > maxDot)
-        {
-            maxDot = dot;
-            bestFace = i;
-        }
+        SweepOptions options;
+        if (!parseSweepArgs(argc - 2, argv + 2, options))
+            return -1;
+        return runSweepCommand(options);
     }
 
-    const std::vector<float> &color = faceColors[bestFace];
-    vertices.insert(vertices.end(), a.begin(), a.end());
-    vertices.insert(vertices.end(), color.begin(), color.end());
-    vertices.insert(vertices.end(), b.begin(), b.end());
-    vertices.insert(vertices.end(), color.begin(), color.end());
-    vertices.insert(vertices.end(), c.begin(), c.end());
-    vertices.insert(vertices.end(), color.begin(), color.end());
-}
-
-void drawKT(std::vector<float> a, std::vector<float> b, std::vector<float> c, int depth,
-            std::vector<float> &vertices)
-{
-    if (depth < maxDepth)
+    for (int i = 1; i < argc; ++i)
     {
-        std::vector<float> mid1 = midpoint(c, a);
-        std::vector<float> mid2 = midpoint(a, b);
-        std::vector<float> mid3 = midpoint(b, c);
-
-        std::vector<float> newA1 = mid1;
-        std::vector<float> newB1 = mid2;
-
-        std::vector<float> newA2 = mid2;
-        std::vector<float> newB2 = mid3;
-
-        std::vector<float> newA3 = mid3;
-        std::vector<float> newB3 = mid1;
-
-        std::vector<float> origNormal = normal(a, b, c);
-        std::vector<float> baseNormal = normal(mid1, mid2, mid3);
-
-        float edgeLength = std::sqrt(
-            (mid1[0] - mid2[0]) * (mid1[0] - mid2[0]) +
-            (mid1[1] - mid2[1]) * (mid1[1] - mid2[1]) +
-            (mid1[2] - mid2[2]) * (mid1[2] - mid2[2]));
-        float height = std::sqrt(2.0f / 3.0f) * edgeLength;
-
-        std::vector<float> centroid = {
-            (mid1[0] + mid2[0] + mid3[0]) / 3.0f,
-            (mid1[1] + mid2[1] + mid3[1]) / 3.0f,
-            (mid1[2] + mid2[2] + mid3[2]) / 3.0f};
-
-        std::vector<float> newC1 = {
-            centroid[0] + baseNormal[0] * height,
-            centroid[1] + baseNormal[1] * height,
-            centroid[2] + baseNormal[2] * height};
-        
-        drawKT(mid1, mid2, newC1, depth + 1, vertices);
-        drawKT(mid2, mid3, newC1, depth + 1, vertices);
-        drawKT(mid3, mid1, newC1, depth + 1, vertices);
-
-        if (depth < (maxDepth - 1))
+        if (std::strcmp(argv[i], "--continuous") == 0)
+            continuousRendering = true;
+        else if (std::strncmp(argv[i], "--latency", 9) == 0)
         {
-            drawKT(a, mid2, mid1, depth + 1, vertices);
-            drawKT(b, mid3, mid2, depth + 1, vertices);
-            drawKT(c, mid1, mid3, depth + 1, vertices);
+            latency.enabled = true;
+            latency.csvPath = argv[i][9] == '=' ? argv[i] + 10 : "latency.csv";
         }
-        else
+        else if (std::strcmp(argv[i], "--perf") == 0)
+            perfCounters = true;
+        else if (std::strcmp(argv[i], "--no-mesh-cache") == 0)
+            useMeshCache = false;
+        else if (std::strncmp(argv[i], "--variant=", 10) == 0)
         {
-            drawTriangle(mid2, mid1, a, vertices);
-            drawTriangle(mid3, mid2, b, vertices);
-            drawTriangle(mid1, mid3, c, vertices);
+            const FractalVariant *variant = findFractalVariant(argv[i] + 10);
+            if (!variant)
+            {
+                std::cout << "unknown variant: " << argv[i] + 10 << std::endl;
+                return -1;
+            }
+            meshVariant = (int)(variant - fractalVariants);
+        }
+        else if (std::strncmp(argv[i], "--vram-budget=", 14) == 0)
+            vramBudget = (size_t)std::atol(argv[i] + 14) << 20;
+        else if (std::strcmp(argv[i], "--no-gpu-cull") == 0)
+            gpuCulling = false;
+        else if (std::strncmp(argv[i], "--cull-pixels=", 14) == 0)
+            cullPixels = (float)std::atof(argv[i] + 14);
+        else if (std::strncmp(argv[i], "--morph-seconds=", 16) == 0)
+            morphSeconds = (float)std::atof(argv[i] + 16);
+        else if (std::strncmp(argv[i], "--trace", 7) == 0)
+            tracePath = argv[i][7] == '=' ? argv[i] + 8 : "trace.json";
+        else if (std::strncmp(argv[i], "--profile", 9) == 0)
+        {
+            profiling = true;
+            if (argv[i][9] == '=')
+                profilePath = argv[i] + 10;
         }
-        //drawTriangle(mid1, mid2, mid3, vertices);
     }
-    else
+
+    if (!tracePath.empty())
     {
-        drawTriangle(a, b, c, vertices);
+        Trace::start();
+        Trace::setThreadName("main (input)");
     }
-};
-
-void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void mouse_callback(GLFWwindow* window, double xpos, double ypos);
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void processInput(GLFWwindow *window);
-void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
 
-int main()
-{
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    {
+        TRACE_SCOPE("glfwInit");
+        glfwInit();
+    }
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    // 4.3 for GPU culling (compute shaders, indirect multi-draw); everything else runs on 3.3
+    const int contextVersions[][2] = {{4, 3}, {3, 3}};
+    GLFWwindow *window = NULL;
+    for (const auto &version : contextVersions)
+    {
+        if (!gpuCulling && version[0] > 3)
+            continue;
+        TRACE_SCOPE("create window");
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+        if (window)
+            break;
+    }
     if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
         return -1;
     }
-    glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback); 
     glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
     
+    // background mesh uploads get a context of their own; without it they run on the render thread
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    uploadWindow = glfwCreateWindow(1, 1, "mesh uploads", NULL, window);
+    if (!uploadWindow)
+        std::cout << "WARNING::MESH_UPLOAD::NO_SHARED_CONTEXT: uploading on the render thread" << std::endl;
+
     glfwSetInputMode(window, GLFW_STICKY_MOUSE_BUTTONS, GLFW_TRUE);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
-    }
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    publishFrameState();
 
-    Shader ourShader("src/shader.vs", "src/shader.fs");
+    // the context is made current on the render thread, which does all GL work from here on
+    std::thread renderThread(renderLoop, window);
 
-    // Tetrahedron vertices
+    while (!glfwWindowShouldClose(window))
+    {
+        float currentFrame = glfwGetTime();
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
 
-    std::vector<float> vertices;
+        double inputStart = glfwGetTime();
+        bool moving;
+        {
+            TRACE_SCOPE("input");
+            moving = processInput(window);
+        }
+        inputSeconds = glfwGetTime() - inputStart;
+        if (sceneDirty)
+        {
+            publishFrameState();
+            sceneDirty = false;
+        }
 
-    drawKT(f1vertex1, f1vertex2, f1vertex3, 0, vertices);
-    drawKT(f2vertex1, f2vertex2, f2vertex3, 0, vertices);
-    drawKT(f3vertex1, f3vertex2, f3vertex3, 0, vertices);
-    drawKT(f4vertex1, f4vertex2, f4vertex3, 0, vertices);
+        if (moving)
+        {
+            // held keys produce no further events, so keep sampling them at a fixed rate
+            glfwWaitEventsTimeout(inputSampleInterval);
+        }
+        else
+        {
+            glfwWaitEventsTimeout(idleWaitTimeout);
+            // don't let the idle time count as movement time on the next sample
+            lastFrame = glfwGetTime();
+        }
+    }
 
-    unsigned int VBO, VAO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
+    {
+        std::lock_guard<std::mutex> lock(renderWakeMutex);
+        renderQuit = true;
+    }
+    renderWake.notify_one();
+    renderThread.join();
+    if (uploadWindow)
+        glfwDestroyWindow(uploadWindow);
+
+    latency.report(std::cout);
+    latency.writeCsv();
+    if (!tracePath.empty())
+    {
+        Trace::stop();
+        Trace::write(tracePath);
+    }
 
-    glBindVertexArray(VAO);
+    glfwTerminate();
+    return 0;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+// main thread: snapshot everything a frame needs and wake the render thread
+void publishFrameState()
+{
+    TRACE_SCOPE("publish");
+    FrameState &state = frameSnapshot.back();
+    state.view = camera.GetViewMatrix();
+    state.zoom = camera.Zoom;
+
+    if(isFirstDown){ //mouse is released, rotate model by preRotX and preRotY
+        totalRotX = preRotX;
+        totalRotY = preRotY;
+    }else{ //mouse is pressed, rotate model by preRotX and preRotY minus rotX and rotY
+        totalRotX = preRotX + rotX;
+        totalRotY = preRotY + rotY;
+    }
+    // Apply Y rotation first (vertical axis), then X (horizontal axis)
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::rotate(model, glm::radians(totalRotY), glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::rotate(model, glm::radians(totalRotX), glm::vec3(0.0f, 1.0f, 0.0f));
+    state.model = model;
+
+    state.aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+    state.framebufferWidth = framebufferWidth;
+    state.framebufferHeight = framebufferHeight;
+    state.renderMode = renderMode;
+    state.depth = meshDepth;
+    state.variant = meshVariant;
+    state.continuous = continuousRendering;
+    state.inputSequence = latency.latestSequence();
+    state.inputSeconds = inputSeconds;
+    state.profiling = profiling;
+    state.overlay = showOverlay;
+    state.profileDumps = profileDumpRequests;
+    frameSnapshot.publish();
 
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-    // color attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    {
+        std::lock_guard<std::mutex> lock(renderWakeMutex);
+        renderWakePending = true;
+    }
+    renderWake.notify_one();
+}
 
-    glEnable(GL_DEPTH_TEST);
+// render thread: owns the GL context for its whole lifetime
+void renderLoop(GLFWwindow *window)
+{
+    Trace::setThreadName("render");
+    bool loaded;
+    {
+        TRACE_SCOPE("make current + load GLAD");
+        glfwMakeContextCurrent(window);
+        loaded = gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+    }
+    if (!loaded)
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        glfwSetWindowShouldClose(window, true);
+        glfwPostEmptyEvent();
+        return;
+    }
 
+    Renderer renderer((GLADloadproc)glfwGetProcAddress);
+    bool culling = gpuCulling && renderer.enableGpuCulling(cullPixels);
+    if (gpuCulling && !culling)
+        std::cout << "WARNING::RENDERER::NO_GPU_CULLING: needs OpenGL 4.3, drawing meshes whole" << std::endl;
+    GpuMeshCache::ContextSwitch uploadContext;
+    if (uploadWindow)
+        uploadContext = [](bool current) { glfwMakeContextCurrent(current ? uploadWindow : NULL); };
+    GpuMeshCache meshes(vramBudget, loadMesh, uploadContext,
+                        []
+                        {
+                            {
+                                std::lock_guard<std::mutex> lock(renderWakeMutex);
+                                renderWakePending = true;
+                            }
+                            renderWake.notify_one();
+                        },
+                        culling);
+    GpuMeshKey shownKey = {~0u, -1};
+    if (perfCounters)
+    {
+        // the path a mesh takes into the viewer: loadMesh (mapped cache entry, or libkt and a cache
+        // store on a miss) and the GPU cache's write into the arena, run synchronously here so the
+        // counters see it; the store after the upload is not counted
+        PerfCounters counters;
+        PerfReport report;
+        GpuMeshKey key = {meshDepth, meshVariant};
+        size_t vertices = (size_t)fractalVariants[key.variant].triangles(KochGenerator(key.depth)) * 3;
+        GpuMeshCache::Source source = [&](const GpuMeshKey &meshKey, const GpuMeshCache::Upload &upload)
+        {
+            loadMesh(meshKey,
+                     [&](const float *data, size_t floats, const float *parents)
+                     {
+                         report.add("load", counters.stop(), floats / 18);
+                         counters.start();
+                         upload(data, floats, parents);
+                         glFinish(); // count the copy even if the driver defers it
+                         report.add("upload", counters.stop(), floats / 18);
+                     });
+        };
+        GpuMeshCache measured(vertices * meshVertexBytes, source, GpuMeshCache::ContextSwitch(),
+                              std::function<void()>(), culling);
+        counters.start();
+        measured.request(key);
+        measured.destroy();
+        if (!counters.available())
+            std::cout << "perf counters unavailable (no perf_event_open access here)" << std::endl;
+        report.print(std::cout);
+    }
 
-    while (!glfwWindowShouldClose(window))
+    FrameState state;
+    unsigned int profileDumps = 0;
+    bool meshChanged = true; // the first frame has to show the new mesh even without input
+    // Geomorphing: a mesh one depth deeper than the one before grows out of its shape (morph 0 to
+    // 1), and before going one depth down the current mesh collapses to the coarser shape (1 to 0)
+    // and only then asks for the coarser mesh, which takes over without a visible change.
+    float morph = 1.0f, morphTarget = 1.0f;
+    GpuMeshKey drawnKey = {~0u, -1};
+    double lastFrameTime = glfwGetTime();
+    while (true)
     {
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-        
-        processInput(window);
-
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        ourShader.use();
-        /*
-        glm::mat4 model = glm::mat4(1.0f);
-        glm::mat4 view = glm::mat4(1.0f);
-        glm::mat4 projection = glm::mat4(1.0f);
-        model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f));
-        view = glm::translate(view, glm::vec3(0.0f, 0.0f, -3.0f));
-        projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-
-        unsigned int modelLoc = glGetUniformLocation(ourShader.ID, "model");
-        unsigned int viewLoc = glGetUniformLocation(ourShader.ID, "view");
-
-        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &view[0][0]);
-
-        ourShader.setMat4("projection", projection);
-        */
-
-        // pass projection matrix to shader (note that in this case it could change every frame)
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        ourShader.setMat4("projection", projection);
-
-        // camera/view transformation
-        glm::mat4 view = camera.GetViewMatrix();
-        ourShader.setMat4("view", view);
-
-        glm::mat4 model = glm::mat4(1.0f);
-        if(isFirstDown){ //mouse is released, rotate model by preRotX and preRotY
-            totalRotX = preRotX;
-            totalRotY = preRotY;
-        }else{ //mouse is pressed, rotate model by preRotX and preRotY minus rotX and rotY
-            totalRotX = preRotX + rotX;
-            totalRotY = preRotY + rotY;
+        {
+            std::unique_lock<std::mutex> lock(renderWakeMutex);
+            // while an upload waits for its fence, keep drawing (the old mesh) so poll() runs
+            if (!state.continuous && !meshChanged && !meshes.pending() && morph == morphTarget)
+                renderWake.wait(lock, [] { return renderWakePending || renderQuit; });
+            renderWakePending = false;
+            if (renderQuit)
+                break;
+        }
+        meshChanged = false;
+        TRACE_SCOPE("frame");
+        frameSnapshot.read(state);
+        GpuMeshKey key = {state.depth, state.variant};
+        const bool morphs = morphSeconds > 0.0f && fractalVariants[key.variant].parents;
+        const bool collapse = morphs && key.variant == drawnKey.variant && key.depth + 1 == drawnKey.depth;
+        morphTarget = collapse ? 0.0f : 1.0f;
+        double now = glfwGetTime();
+        float step = morphSeconds > 0.0f ? (float)(now - lastFrameTime) / morphSeconds : 1.0f;
+        lastFrameTime = now;
+        morph = morph < morphTarget ? std::min(morphTarget, morph + step) : std::max(morphTarget, morph - step);
+        if (!(key == shownKey) && (!collapse || morph == 0.0f))
+        {
+            meshes.request(key);
+            shownKey = key;
         }
-        // Apply Y rotation first (vertical axis), then X (horizontal axis)
-        model = glm::rotate(model, glm::radians(totalRotY), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(totalRotX), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
+        if (meshes.poll())
+        {
+            const GpuMesh *mesh = meshes.active();
+            renderer.showMesh(meshes.vertexArray(), mesh);
+            // a compaction also reports a change, of the same mesh
+            if (mesh && !(mesh->key == drawnKey))
+            {
+                bool grows = morphs && mesh->key.variant == drawnKey.variant && mesh->key.depth == drawnKey.depth + 1;
+                morph = grows ? 0.0f : 1.0f;
+                drawnKey = mesh->key;
+            }
+        }
+        renderer.setMorph(morph);
+        FrameProfiler &profiler = renderer.profiler;
+        profiler.enabled = state.profiling || state.overlay;
+        profiler.beginFrame();
+
+        renderer.drawFrame(state);
 
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 6);
+        profiler.beginCpu(renderer.swapPhase);
+        {
+            TRACE_SCOPE("swap");
+            glfwSwapBuffers(window);
+        }
+        profiler.endCpu(renderer.swapPhase);
+        latency.frameSubmitted(state.inputSequence);
+        profiler.endFrame();
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (state.profileDumps != profileDumps)
+        {
+            profileDumps = state.profileDumps;
+            profiler.print(std::cout);
+            profiler.dump(profilePath);
+        }
     }
 
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    if (state.profiling)
+    {
+        renderer.profiler.print(std::cout);
+        renderer.profiler.dump(profilePath);
+    }
+    latency.destroy();
+    meshes.destroy();
+    renderer.destroy();
+    glfwMakeContextCurrent(NULL);
+}
 
-    glfwTerminate();
-    return 0;
+// mesh upload thread: hands the mesh for key to upload, straight from the mapped cache entry when
+// there is one, generating (and caching) it on a miss
+void loadMesh(const GpuMeshKey &key, const GpuMeshCache::Upload &upload)
+{
+    const FractalVariant &variant = fractalVariants[key.variant];
+    KochGenerator generator(key.depth);
+    // where each vertex sits one depth up, for geomorphing; only for meshes that can morph, and
+    // kept in the mesh cache entry so a hit never runs the generator
+    const bool morphs = morphSeconds > 0.0f && variant.parents && key.depth > 0;
+    // cache entries are keyed by KochConfig, which only describes the koch rules
+    const bool cacheable = useMeshCache && &variant == &fractalVariants[0];
+    if (cacheable)
+    {
+        MappedMesh cached;
+        bool hit;
+        {
+            TRACE_SCOPE("mesh cache load");
+            hit = MeshCache::load(generator.config(), cached, morphs);
+        }
+        if (hit)
+        {
+            upload(cached.data(), cached.floats(), cached.parents());
+            return;
+        }
+    }
+    std::vector<float> vertices;
+    if (&variant == &fractalVariants[0])
+    {
+        // through libkt, the same entry point other tools generate with
+        TRACE_SCOPE("kt_generate");
+        vertices.resize((size_t)kt_count(key.depth) * KT_FLOATS_PER_TRIANGLE);
+        int64_t written = kt_generate(key.depth, vertices.data(), vertices.size());
+        if (written < 0)
+        {
+            // no upload: the cache reports the missing mesh and gives its range back
+            std::cout << "ERROR::KT::GENERATE_FAILED: depth " << key.depth << ": " << kt_error_string(written) << std::endl;
+            return;
+        }
+    }
+    else
+        vertices = variant.generate(generator);
+    std::vector<float> parents;
+    if (morphs)
+    {
+        TRACE_SCOPE("generate parents");
+        parents = variant.parents(generator);
+    }
+    upload(vertices.data(), vertices.size(), parents.empty() ? NULL : parents.data());
+    if (cacheable)
+    {
+        TRACE_SCOPE("mesh cache store");
+        MeshCache::store(generator.config(), vertices, parents);
+    }
 }
 
 void mouse_button_callback(GLFWwindow *window, int button, int action, int mods) {
     if (button == GLFW_MOUSE_BUTTON_LEFT) {
+        latency.recordInput();
+        sceneDirty = true;
         if (action == GLFW_PRESS) {
             isFirstDown = false;
             double xpos, ypos;
@@ -380,8 +578,51 @@ void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
     }
 }
 
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    if (action != GLFW_PRESS)
+        return;
+    latency.recordInput();
+    if (key == GLFW_KEY_M)
+    {
+        renderMode = (renderMode + 1) % renderModeCount;
+        sceneDirty = true;
+    }
+    else if (key == GLFW_KEY_C)
+    {
+        continuousRendering = !continuousRendering;
+        std::cout << (continuousRendering ? "continuous rendering" : "on-demand rendering") << std::endl;
+        sceneDirty = true;
+    }
+    else if (key == GLFW_KEY_O)
+    {
+        showOverlay = !showOverlay;
+        sceneDirty = true;
+    }
+    else if (key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET || key == GLFW_KEY_V)
+    {
+        // the render thread picks the new key up from the frame state and swaps meshes when ready
+        if (key == GLFW_KEY_LEFT_BRACKET && meshDepth > 0)
+            --meshDepth;
+        else if (key == GLFW_KEY_RIGHT_BRACKET && meshDepth < maxViewerDepth)
+            ++meshDepth;
+        else if (key == GLFW_KEY_V)
+            meshVariant = (meshVariant + 1) % (int)(sizeof(fractalVariants) / sizeof(fractalVariants[0]));
+        std::cout << "depth " << meshDepth << " (" << fractalVariants[meshVariant].name << ")" << std::endl;
+        sceneDirty = true;
+    }
+    else if (key == GLFW_KEY_P)
+    {
+        // the render thread owns the profiler; it dumps when it sees the request count change
+        profiling = true;
+        ++profileDumpRequests;
+        sceneDirty = true;
+    }
+}
+
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
 {
+    latency.recordInput();
     float xpos = static_cast<float>(xposIn);
     float ypos = static_cast<float>(yposIn);
 
@@ -397,6 +638,7 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
 
     lastX = xpos;
     lastY = ypos;
+    sceneDirty = true;
     if(isFirstDown){
         camera.ProcessMouseMovement(xoffset, yoffset);
     } else {
@@ -415,27 +657,53 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
+    latency.recordInput();
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    sceneDirty = true;
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow *window)
+bool processInput(GLFWwindow *window)
 {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
+    bool moved = false;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    {
         camera.ProcessKeyboard(FORWARD, deltaTime);
+        moved = true;
+    }
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    {
         camera.ProcessKeyboard(BACKWARD, deltaTime);
+        moved = true;
+    }
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    {
         camera.ProcessKeyboard(LEFT, deltaTime);
+        moved = true;
+    }
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    {
         camera.ProcessKeyboard(RIGHT, deltaTime);
+        moved = true;
+    }
+    if (moved)
+        sceneDirty = true;
+    return moved;
+}
+
+void window_refresh_callback(GLFWwindow *window)
+{
+    sceneDirty = true;
 }
 
+// the viewport itself is set by the render thread once it sees the new size
 void framebuffer_size_callback(GLFWwindow *window, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    framebufferWidth = width;
+    framebufferHeight = height;
+    sceneDirty = true;
 }
\ No newline at end of file
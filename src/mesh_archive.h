@@ -0,0 +1,491 @@
+#ifndef MESH_ARCHIVE_H
+#define MESH_ARCHIVE_H
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Compressed archival mesh format (.ktz).
+//
+// Every vertex of a depth-d mesh sits on the lattice 2^-d (the midpoints halve the base cube's
+// edges and the new apexes land on the same grid), and triangles arrive in recursion order, so
+// neighbouring vertices are close. Each block therefore stores
+//   - positions as lattice integers, delta coded against the previous vertex and zigzag mapped,
+//     as one rANS coded byte per coordinate (large deltas escape to a varint side stream),
+//   - colours as an index into a per-block palette, one rANS coded symbol per triangle.
+// Positions decode to the exact lattice point; the generator's floats carry rounding noise of
+// about one ulp around it, which is all that is lost. A block whose vertices do not sit on a
+// lattice within 4 ulp, or that has more than four colours, is stored raw instead.
+//
+// File: ArchiveHeader, then blocks of up to archiveBlockTriangles triangles, each starting with
+// a BlockHeader that carries its own size, so blocks are found with a quick scan and then
+// decoded independently on all cores.
+
+const uint32_t ARCHIVE_MAGIC = 0x315a544b; // "KTZ1"
+const uint32_t ARCHIVE_BLOCK_MAGIC = 0x425a544b; // "KTZB"
+const uint32_t ARCHIVE_VERSION = 1;
+const size_t archiveBlockTriangles = 1 << 14;
+
+struct ArchiveHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t depth;
+    uint32_t reserved;
+    uint64_t triangles;
+};
+
+struct ArchiveBlockHeader
+{
+    uint32_t magic;
+    uint8_t type; // BLOCK_LATTICE or BLOCK_RAW
+    uint8_t shift; // lattice step is 2^-shift
+    uint8_t paletteSize;
+    uint8_t reserved;
+    uint32_t triangles;
+    uint32_t payloadBytes;
+};
+
+enum { BLOCK_RAW = 0, BLOCK_LATTICE = 1 };
+
+// 32-bit rANS with byte-wise renormalisation and 12-bit frequencies
+// ------------------------------------------------------------------------
+namespace rans
+{
+const uint32_t SCALE_BITS = 12;
+const uint32_t SCALE = 1u << SCALE_BITS;
+const uint32_t LOWER_BOUND = 1u << 23;
+
+// scales symbol counts to frequencies summing to SCALE, keeping every used symbol at least 1
+inline void normalize(const uint32_t *counts, int symbols, uint16_t *freqs)
+{
+    uint64_t total = 0;
+    for (int s = 0; s < symbols; ++s)
+        total += counts[s];
+    int sum = 0;
+    for (int s = 0; s < symbols; ++s)
+    {
+        freqs[s] = counts[s] ? (uint16_t)std::max<uint64_t>(1, (uint64_t)counts[s] * SCALE / total) : 0;
+        sum += freqs[s];
+    }
+    // settle the rounding on the most frequent symbols, which barely notice
+    while (sum != (int)SCALE)
+    {
+        int best = -1;
+        for (int s = 0; s < symbols; ++s)
+            if (freqs[s] > (sum > (int)SCALE ? 1 : 0) && (best < 0 || freqs[s] > freqs[best]))
+                best = s;
+        if (best < 0)
+            break;
+        int step = sum > (int)SCALE ? -1 : 1;
+        freqs[best] = (uint16_t)(freqs[best] + step);
+        sum += step;
+    }
+}
+
+// encodes symbols into out (appended); the frequency table is written first as used-symbol pairs
+inline void encode(const uint8_t *symbols, size_t count, int alphabet, std::string &out)
+{
+    uint32_t counts[256] = {};
+    for (size_t i = 0; i < count; ++i)
+        ++counts[symbols[i]];
+    uint16_t freqs[256] = {}, starts[256] = {};
+    if (count)
+        normalize(counts, alphabet, freqs);
+    uint8_t used = 0;
+    for (int s = 0, start = 0; s < alphabet; ++s)
+    {
+        starts[s] = (uint16_t)start;
+        start += freqs[s];
+        used += freqs[s] ? 1 : 0;
+    }
+    // 256 used symbols wrap to 0 here; the decoder reads a zero count as 256 when data follows
+    out.push_back((char)used);
+    for (int s = 0; s < alphabet; ++s)
+        if (freqs[s])
+        {
+            out.push_back((char)s);
+            out.append((const char *)&freqs[s], 2);
+        }
+
+    // rANS writes backwards; encode in reverse so the decoder reads forwards
+    std::vector<uint8_t> buffer(count * 2 + 16);
+    uint8_t *end = buffer.data() + buffer.size(), *ptr = end;
+    uint32_t x = LOWER_BOUND;
+    for (size_t i = count; i-- > 0;)
+    {
+        uint32_t freq = freqs[symbols[i]];
+        uint32_t xMax = ((LOWER_BOUND >> SCALE_BITS) << 8) * freq;
+        while (x >= xMax)
+        {
+            *--ptr = (uint8_t)(x & 0xff);
+            x >>= 8;
+        }
+        x = ((x / freq) << SCALE_BITS) + (x % freq) + starts[symbols[i]];
+    }
+    ptr -= 4;
+    ptr[0] = (uint8_t)x;
+    ptr[1] = (uint8_t)(x >> 8);
+    ptr[2] = (uint8_t)(x >> 16);
+    ptr[3] = (uint8_t)(x >> 24);
+    uint32_t bytes = (uint32_t)(end - ptr);
+    out.append((const char *)&bytes, 4);
+    out.append((const char *)ptr, bytes);
+}
+
+// decodes count symbols; advances in past the stream, false on malformed input
+inline bool decode(const uint8_t *&in, const uint8_t *limit, uint8_t *symbols, size_t count)
+{
+    if (in >= limit)
+        return false;
+    int used = *in++;
+    if (used == 0 && count)
+        used = 256;
+    uint16_t freqs[256] = {}, starts[256] = {};
+    if (limit - in < used * 3 + 4)
+        return false;
+    for (int i = 0; i < used; ++i)
+    {
+        uint8_t s = in[0];
+        std::memcpy(&freqs[s], in + 1, 2);
+        in += 3;
+    }
+    uint8_t lookup[SCALE];
+    int total = 0;
+    for (int s = 0; s < 256; ++s)
+    {
+        if (total + freqs[s] > (int)SCALE)
+            return false;
+        starts[s] = (uint16_t)total;
+        std::memset(lookup + total, s, freqs[s]);
+        total += freqs[s];
+    }
+    if (count && total != (int)SCALE)
+        return false;
+    uint32_t bytes;
+    std::memcpy(&bytes, in, 4);
+    in += 4;
+    if (bytes < 4 || (size_t)(limit - in) < bytes)
+        return false;
+    const uint8_t *ptr = in, *end = in + bytes;
+    in = end;
+    uint32_t x = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((uint32_t)ptr[3] << 24);
+    ptr += 4;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t slot = x & (SCALE - 1);
+        uint8_t s = lookup[slot];
+        symbols[i] = s;
+        x = freqs[s] * (x >> SCALE_BITS) + slot - starts[s];
+        while (x < LOWER_BOUND)
+        {
+            if (ptr == end)
+                return false;
+            x = (x << 8) | *ptr++;
+        }
+    }
+    return true;
+}
+} // namespace rans
+
+inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+// the coarsest lattice all coordinates of the block sit on within 4 ulp, or -1
+inline int findLatticeShift(const float *vertices, size_t triangles)
+{
+    for (int shift = 0; shift <= 24; ++shift)
+    {
+        double scale = std::ldexp(1.0, shift);
+        bool fits = true;
+        for (size_t i = 0; i < triangles * 3 && fits; ++i)
+            for (int k = 0; k < 3 && fits; ++k)
+            {
+                float x = vertices[i * 6 + k];
+                double q = std::nearbyint(x * scale);
+                fits = std::fabs(q) < 2147483647.0 &&
+                       std::fabs((float)(q / scale) - x) <= 4 * FLT_EPSILON * std::max(1.0f, std::fabs(x));
+            }
+        if (fits)
+            return shift;
+    }
+    return -1;
+}
+
+// encodes one block and appends it to out
+inline void encodeArchiveBlock(const float *vertices, size_t triangles, std::string &out)
+{
+    ArchiveBlockHeader header = {ARCHIVE_BLOCK_MAGIC, BLOCK_RAW, 0, 0, 0, (uint32_t)triangles, 0};
+    size_t headerAt = out.size();
+    out.append((const char *)&header, sizeof(header));
+
+    // palette: every triangle is one colour (drawTriangle), at most four of them
+    float palette[4][3];
+    std::vector<uint8_t> colours(triangles);
+    int paletteSize = 0;
+    for (size_t t = 0; t < triangles && paletteSize >= 0; ++t)
+    {
+        const float *c = vertices + t * 18 + 3;
+        if (std::memcmp(c, vertices + t * 18 + 9, 12) != 0 || std::memcmp(c, vertices + t * 18 + 15, 12) != 0)
+        {
+            paletteSize = -1;
+            break;
+        }
+        int index = 0;
+        while (index < paletteSize && std::memcmp(palette[index], c, 12) != 0)
+            ++index;
+        if (index == paletteSize)
+        {
+            if (paletteSize == 4)
+            {
+                paletteSize = -1;
+                break;
+            }
+            std::memcpy(palette[paletteSize++], c, 12);
+        }
+        colours[t] = (uint8_t)index;
+    }
+    int shift = paletteSize >= 0 ? findLatticeShift(vertices, triangles) : -1;
+
+    if (shift < 0)
+        out.append((const char *)vertices, triangles * 18 * sizeof(float));
+    else
+    {
+        header.type = BLOCK_LATTICE;
+        header.shift = (uint8_t)shift;
+        header.paletteSize = (uint8_t)paletteSize;
+        out.append((const char *)palette, paletteSize * 12);
+
+        double scale = std::ldexp(1.0, shift);
+        std::vector<uint8_t> tokens(triangles * 9);
+        std::string escapes;
+        int32_t previous[3] = {0, 0, 0};
+        for (size_t i = 0; i < triangles * 3; ++i)
+            for (int k = 0; k < 3; ++k)
+            {
+                int32_t q = (int32_t)std::nearbyint(vertices[i * 6 + k] * scale);
+                uint32_t z = zigzag(q - previous[k]);
+                previous[k] = q;
+                if (z < 255)
+                    tokens[i * 3 + k] = (uint8_t)z;
+                else
+                {
+                    tokens[i * 3 + k] = 255;
+                    for (z -= 255; z >= 0x80; z >>= 7)
+                        escapes.push_back((char)(z | 0x80));
+                    escapes.push_back((char)z);
+                }
+            }
+        rans::encode(tokens.data(), tokens.size(), 256, out);
+        if (paletteSize > 1)
+            rans::encode(colours.data(), colours.size(), paletteSize, out);
+        uint32_t escapeBytes = (uint32_t)escapes.size();
+        out.append((const char *)&escapeBytes, 4);
+        out += escapes;
+    }
+    header.payloadBytes = (uint32_t)(out.size() - headerAt - sizeof(header));
+    std::memcpy(&out[headerAt], &header, sizeof(header));
+}
+
+// decodes one block into out (triangles * 18 floats); false on malformed input
+inline bool decodeArchiveBlock(const ArchiveBlockHeader &header, const uint8_t *payload, float *out)
+{
+    const uint8_t *in = payload, *limit = payload + header.payloadBytes;
+    size_t triangles = header.triangles;
+    if (header.type == BLOCK_RAW)
+    {
+        if (header.payloadBytes != triangles * 18 * sizeof(float))
+            return false;
+        std::memcpy(out, payload, header.payloadBytes);
+        return true;
+    }
+    if (header.type != BLOCK_LATTICE || header.paletteSize < 1 || header.paletteSize > 4 ||
+        header.payloadBytes < header.paletteSize * 12u)
+        return false;
+    float palette[4][3];
+    std::memcpy(palette, in, header.paletteSize * 12);
+    in += header.paletteSize * 12;
+
+    std::vector<uint8_t> tokens(triangles * 9), colours(triangles, 0);
+    if (!rans::decode(in, limit, tokens.data(), tokens.size()))
+        return false;
+    if (header.paletteSize > 1 && !rans::decode(in, limit, colours.data(), colours.size()))
+        return false;
+    uint32_t escapeBytes;
+    if (limit - in < 4)
+        return false;
+    std::memcpy(&escapeBytes, in, 4);
+    in += 4;
+    const uint8_t *escape = in, *escapeEnd = in + escapeBytes;
+    if (escapeEnd > limit)
+        return false;
+
+    const double step = std::ldexp(1.0, -(int)header.shift);
+    int32_t previous[3] = {0, 0, 0};
+    for (size_t t = 0; t < triangles; ++t)
+    {
+        if (colours[t] >= header.paletteSize)
+            return false;
+        const float *colour = palette[colours[t]];
+        for (int v = 0; v < 3; ++v)
+        {
+            float *vertex = out + t * 18 + v * 6;
+            const uint8_t *token = &tokens[t * 9 + v * 3];
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t z = token[k];
+                if (z == 255)
+                {
+                    uint32_t extra = 0;
+                    for (int bits = 0;; bits += 7)
+                    {
+                        if (escape == escapeEnd || bits > 28)
+                            return false;
+                        uint8_t byte = *escape++;
+                        extra |= (uint32_t)(byte & 0x7f) << bits;
+                        if (!(byte & 0x80))
+                            break;
+                    }
+                    z = 255 + extra;
+                }
+                previous[k] += unzigzag(z);
+                vertex[k] = (float)(previous[k] * step);
+            }
+            std::memcpy(vertex + 3, colour, 12);
+        }
+    }
+    return true;
+}
+
+// encodes triangles as consecutive blocks, on all hardware threads
+inline void encodeArchiveBlocks(const float *vertices, size_t triangles, std::vector<std::string> &blocks)
+{
+    blocks.assign((triangles + archiveBlockTriangles - 1) / archiveBlockTriangles, std::string());
+    unsigned int threads =
+        (unsigned int)std::min<size_t>(blocks.size(), std::max(1u, std::thread::hardware_concurrency()));
+    auto work = [&](unsigned int first)
+    {
+        for (size_t b = first; b < blocks.size(); b += threads)
+        {
+            size_t begin = b * archiveBlockTriangles;
+            encodeArchiveBlock(vertices + begin * 18, std::min(archiveBlockTriangles, triangles - begin), blocks[b]);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; ++t)
+        workers.emplace_back(work, t);
+    if (threads)
+        work(0);
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+// a complete archive in memory
+inline std::string encodeArchive(const std::vector<float> &vertices, unsigned int depth)
+{
+    ArchiveHeader header = {ARCHIVE_MAGIC, ARCHIVE_VERSION, depth, 0, vertices.size() / 18};
+    std::vector<std::string> blocks;
+    encodeArchiveBlocks(vertices.data(), vertices.size() / 18, blocks);
+    std::string archive((const char *)&header, sizeof(header));
+    for (const std::string &block : blocks)
+        archive += block;
+    return archive;
+}
+
+// Decodes a whole archive held in memory. Blocks are located with one pass over their headers,
+// then decoded on up to threads threads (0: all hardware threads) straight into vertices.
+inline bool decodeArchive(const uint8_t *data, size_t size, std::vector<float> &vertices, unsigned int threads = 0)
+{
+    ArchiveHeader header;
+    if (size < sizeof(header))
+        return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION)
+    {
+        std::cout << "ERROR::ARCHIVE::NOT_AN_ARCHIVE" << std::endl;
+        return false;
+    }
+
+    struct Block
+    {
+        ArchiveBlockHeader header;
+        const uint8_t *payload;
+        unsigned long long firstTriangle;
+    };
+    std::vector<Block> blocks;
+    unsigned long long triangles = 0;
+    for (size_t offset = sizeof(header); offset < size;)
+    {
+        Block block;
+        if (size - offset < sizeof(ArchiveBlockHeader))
+            return false;
+        std::memcpy(&block.header, data + offset, sizeof(ArchiveBlockHeader));
+        offset += sizeof(ArchiveBlockHeader);
+        if (block.header.magic != ARCHIVE_BLOCK_MAGIC || size - offset < block.header.payloadBytes)
+        {
+            std::cout << "ERROR::ARCHIVE::CORRUPT_BLOCK at byte " << offset << std::endl;
+            return false;
+        }
+        block.payload = data + offset;
+        block.firstTriangle = triangles;
+        triangles += block.header.triangles;
+        offset += block.header.payloadBytes;
+        blocks.push_back(block);
+    }
+    if (triangles != header.triangles)
+    {
+        std::cout << "ERROR::ARCHIVE::TRUNCATED: " << triangles << " of " << header.triangles << " triangles" << std::endl;
+        return false;
+    }
+
+    vertices.resize(triangles * 18);
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned int)std::min<size_t>(threads, std::max<size_t>(1, blocks.size()));
+    std::vector<char> ok(threads, 1);
+    auto work = [&](unsigned int first)
+    {
+        for (size_t b = first; b < blocks.size() && ok[first]; b += threads)
+            ok[first] = decodeArchiveBlock(blocks[b].header, blocks[b].payload,
+                                           vertices.data() + blocks[b].firstTriangle * 18);
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; ++t)
+        workers.emplace_back(work, t);
+    work(0);
+    for (std::thread &worker : workers)
+        worker.join();
+    for (char success : ok)
+        if (!success)
+        {
+            std::cout << "ERROR::ARCHIVE::CORRUPT_BLOCK" << std::endl;
+            return false;
+        }
+    return true;
+}
+
+inline bool readArchive(const std::string &path, std::vector<float> &vertices, unsigned int threads = 0)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        std::cout << "ERROR::ARCHIVE::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> data((size_t)file.tellg());
+    file.seekg(0);
+    if (!file.read((char *)data.data(), data.size()))
+    {
+        std::cout << "ERROR::ARCHIVE::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    return decodeArchive(data.data(), data.size(), vertices, threads);
+}
+#endif
@@ -0,0 +1,179 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Free-list allocator over [0, capacity) in abstract units. Free ranges are kept sorted by
+// offset, so a free merges with both neighbours in O(log n) and the list never holds two
+// adjacent holes. Allocation is best fit, which keeps large holes intact for deep meshes.
+class RangeAllocator
+{
+public:
+    explicit RangeAllocator(size_t capacity = 0) { reset(capacity); }
+
+    // everything free again
+    void reset(size_t capacity)
+    {
+        total = capacity;
+        holes.clear();
+        if (capacity)
+            holes[0] = capacity;
+        freeUnits = capacity;
+    }
+
+    bool allocate(size_t size, size_t &offset)
+    {
+        if (size == 0)
+            return false;
+        auto best = holes.end();
+        for (auto it = holes.begin(); it != holes.end(); ++it)
+            if (it->second >= size && (best == holes.end() || it->second < best->second))
+                best = it;
+        if (best == holes.end())
+            return false;
+        offset = best->first;
+        size_t remaining = best->second - size;
+        holes.erase(best);
+        if (remaining)
+            holes[offset + size] = remaining;
+        freeUnits -= size;
+        return true;
+    }
+
+    void free(size_t offset, size_t size)
+    {
+        if (size == 0)
+            return;
+        freeUnits += size;
+        auto next = holes.lower_bound(offset);
+        if (next != holes.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = holes.erase(next);
+        }
+        if (next != holes.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                previous->second += size;
+                return;
+            }
+        }
+        holes[offset] = size;
+    }
+
+    size_t capacity() const { return total; }
+    size_t freeTotal() const { return freeUnits; }
+    size_t largestFree() const
+    {
+        size_t largest = 0;
+        for (const auto &hole : holes)
+            largest = std::max(largest, hole.second);
+        return largest;
+    }
+    size_t holeCount() const { return holes.size(); }
+
+private:
+    size_t total = 0;
+    size_t freeUnits = 0;
+    std::map<size_t, size_t> holes; // offset -> size
+};
+
+// One GL buffer holding every mesh, sub-allocated in whole vertices, and the one vertex array
+// that reads it. A mesh is just a range of it: drawn with glDrawArrays(first = its offset), so
+// switching meshes, LODs or variants never rebinds a buffer or a vertex array.
+class MeshArena
+{
+public:
+    // capacity in vertices of vertexBytes each; configure sets the attribute pointers of the bound
+    // vertex array to the bound GL_ARRAY_BUFFER. Needs a current context.
+    void create(size_t capacityVertices, size_t vertexBytes, void (*configure)())
+    {
+        stride = vertexBytes;
+        allocator.reset(capacityVertices);
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(capacityVertices * stride), NULL, GL_STATIC_DRAW);
+        configure();
+        // other contexts sharing the buffer (uploads) only see it once the creation has been flushed
+        glFlush();
+    }
+
+    GLuint buffer() const { return vbo; }
+    GLuint vertexArray() const { return vao; }
+    size_t vertexBytes() const { return stride; }
+    const RangeAllocator &ranges() const { return allocator; }
+
+    bool allocate(size_t vertices, size_t &first) { return allocator.allocate(vertices, first); }
+    void free(size_t first, size_t vertices) { allocator.free(first, vertices); }
+
+    // Slides every live range down to the start of the buffer, in offset order, so all free space
+    // ends up in one hole at the end. blocks are (first vertex, vertex count) pairs and are updated
+    // in place. The ranges that move go out to a scratch buffer, packed, with one copy each and
+    // come back with a single copy, so the number of copies never depends on the size of the holes
+    // between them. The copies run on the GPU in command order, after every draw already submitted
+    // from this context, so nothing has to wait.
+    void compact(std::vector<std::pair<size_t *, size_t>> &blocks)
+    {
+        std::sort(blocks.begin(), blocks.end(),
+                  [](const std::pair<size_t *, size_t> &a, const std::pair<size_t *, size_t> &b)
+                  { return *a.first < *b.first; });
+        // ranges already packed at the front stay where they are
+        size_t settled = 0, end = 0;
+        while (settled < blocks.size() && *blocks[settled].first == end)
+            end += blocks[settled++].second;
+        size_t start = end;
+        for (size_t i = settled; i < blocks.size(); ++i)
+            end += blocks[i].second;
+        if (end > start)
+        {
+            GLuint scratch = 0;
+            glGenBuffers(1, &scratch);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+            glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)((end - start) * stride), NULL, GL_STREAM_COPY);
+            glBindBuffer(GL_COPY_READ_BUFFER, vbo);
+            size_t packed = 0;
+            for (size_t i = settled; i < blocks.size(); ++i)
+            {
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)(*blocks[i].first * stride),
+                                    (GLintptr)(packed * stride), (GLsizeiptr)(blocks[i].second * stride));
+                *blocks[i].first = start + packed;
+                packed += blocks[i].second;
+            }
+            glBindBuffer(GL_COPY_READ_BUFFER, scratch);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, (GLintptr)(start * stride),
+                                (GLsizeiptr)(packed * stride));
+            // the GL keeps the storage until the copies that use it have run
+            glDeleteBuffers(1, &scratch);
+        }
+        allocator.reset(allocator.capacity());
+        size_t first = 0;
+        if (end)
+            allocator.allocate(end, first);
+    }
+
+    void destroy()
+    {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        vao = vbo = 0;
+        allocator.reset(0);
+    }
+
+private:
+    RangeAllocator allocator;
+    GLuint vbo = 0, vao = 0;
+    size_t stride = 0;
+};
+#endif
@@ -0,0 +1,268 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "koch_generator.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MESH_CACHE_MMAP 1
+#elif defined(_WIN32)
+#include <process.h>
+#endif
+
+// Read-only view of a cached mesh. On POSIX the file is mmap'ed and data() points straight into
+// the page cache, so it can go to glBufferData without a copy or any parsing; elsewhere the
+// vertices are read into an owned buffer instead.
+class MappedMesh
+{
+public:
+    MappedMesh() {}
+    MappedMesh(const MappedMesh &) = delete;
+    MappedMesh &operator=(const MappedMesh &) = delete;
+    ~MappedMesh() { release(); }
+
+    const float *data() const { return vertices; }
+    // number of floats (6 per vertex, interleaved position/colour)
+    size_t floats() const { return count; }
+    // each vertex's parent position (3 floats, ParentOutput in fractal_rules.h) when the entry has
+    // them and they were asked for, NULL otherwise
+    const float *parents() const { return parentData; }
+    bool empty() const { return count == 0; }
+
+    void release()
+    {
+#ifdef MESH_CACHE_MMAP
+        if (mapping)
+            munmap(mapping, mappingSize);
+#endif
+        mapping = NULL;
+        mappingSize = 0;
+        owned.clear();
+        owned.shrink_to_fit();
+        vertices = NULL;
+        parentData = NULL;
+        count = 0;
+    }
+
+private:
+    friend class MeshCache;
+    void *mapping = NULL;
+    size_t mappingSize = 0;
+    std::vector<float> owned;
+    const float *vertices = NULL;
+    const float *parentData = NULL;
+    size_t count = 0;
+};
+
+// On-disk cache of generated meshes, one file per depth. Entries are keyed by the whole
+// KochConfig (depth, base tetrahedron, palette, apex height, corner rule) and the vertex layout, so changing
+// any of them simply misses and regenerates. The payload is the VBO contents verbatim after a fixed
+// 64-byte header, which keeps the mapped vertex data 16-byte aligned, optionally followed by the
+// parent position of every vertex for geomorphing, so a hit never has to run the generator.
+class MeshCache
+{
+public:
+    static const char *directory() { return "mesh_cache"; }
+
+    // 64-bit FNV-1a over the format, depth and everything the generator output depends on
+    static uint64_t key(const KochConfig &config)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const void *data, size_t size)
+        {
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash ^= ((const unsigned char *)data)[i];
+                hash *= 1099511628211ull;
+            }
+        };
+        auto mixVector = [&mix](const std::vector<float> &v) { mix(v.data(), v.size() * sizeof(float)); };
+        const uint32_t fields[] = {FORMAT_VERSION, FLOATS_PER_VERTEX, PARENT_FLOATS_PER_VERTEX, PARENT_LAYOUT,
+                                   (uint32_t)sizeof(float), config.depth};
+        mix(fields, sizeof(fields));
+        for (const auto &face : config.faces)
+            for (const std::vector<float> &vertex : face)
+                mixVector(vertex);
+        for (const std::vector<float> &color : config.palette)
+            mixVector(color);
+        mix(&config.apexHeightRatio, sizeof(config.apexHeightRatio));
+        mix(&config.cornerLevels, sizeof(config.cornerLevels));
+        return hash;
+    }
+
+    // maps the cached mesh for config into mesh; returns false on a miss or a bad entry, and, with
+    // withParents, on an entry stored without parents
+    static bool load(const KochConfig &config, MappedMesh &mesh, bool withParents = false)
+    {
+        mesh.release();
+        const uint64_t expected = key(config);
+        const std::string file = path(config.depth);
+#ifdef MESH_CACHE_MMAP
+        int fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        void *mapping = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(Header))
+            mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd); // the mapping keeps the file alive
+        if (mapping == MAP_FAILED)
+            return false;
+        const Header &header = *(const Header *)mapping;
+        if (!valid(header, expected, (uint64_t)info.st_size))
+        {
+            munmap(mapping, (size_t)info.st_size);
+            std::cout << "WARNING::MESH_CACHE::STALE_ENTRY: " << file << std::endl;
+            return false;
+        }
+        if (withParents && !header.parentFloatsPerVertex)
+        {
+            munmap(mapping, (size_t)info.st_size);
+            return false;
+        }
+        // one sequential pass into the GL driver follows; start the readahead now
+        madvise(mapping, (size_t)info.st_size, MADV_SEQUENTIAL);
+        madvise(mapping, (size_t)info.st_size, MADV_WILLNEED);
+        mesh.mapping = mapping;
+        mesh.mappingSize = (size_t)info.st_size;
+        mesh.vertices = (const float *)((const char *)mapping + sizeof(Header));
+        mesh.count = (size_t)header.vertexCount * FLOATS_PER_VERTEX;
+        if (withParents)
+            mesh.parentData = mesh.vertices + mesh.count;
+        return true;
+#else
+        std::ifstream in(file, std::ios::binary | std::ios::ate);
+        if (!in)
+            return false;
+        uint64_t size = (uint64_t)in.tellg();
+        in.seekg(0);
+        Header header;
+        if (size < sizeof(Header) || !in.read((char *)&header, sizeof(header)) || !valid(header, expected, size))
+            return false;
+        if (withParents && !header.parentFloatsPerVertex)
+            return false;
+        const size_t count = (size_t)header.vertexCount * FLOATS_PER_VERTEX;
+        mesh.owned.resize(count + (withParents ? (size_t)header.vertexCount * PARENT_FLOATS_PER_VERTEX : 0));
+        if (!in.read((char *)mesh.owned.data(), mesh.owned.size() * sizeof(float)))
+        {
+            mesh.release();
+            return false;
+        }
+        mesh.vertices = mesh.owned.data();
+        mesh.count = count;
+        if (withParents)
+            mesh.parentData = mesh.vertices + count;
+        return true;
+#endif
+    }
+
+    // writes the generated mesh for config, with its parents (3 floats per vertex) unless that is
+    // empty; failures only cost the next launch a regeneration
+    static bool store(const KochConfig &config, const std::vector<float> &vertices,
+                      const std::vector<float> &parents = std::vector<float>())
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(directory(), ec);
+        // write to a temporary of this writer's own and rename, so a concurrent launch never maps
+        // a torn entry: the last rename wins and each one moves a complete file
+        std::string finalPath = path(config.depth);
+        std::string tmpPath = temporaryPath(finalPath);
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                std::cout << "WARNING::MESH_CACHE::CANNOT_WRITE: " << tmpPath << std::endl;
+                return false;
+            }
+            Header header = {};
+            header.magic = MAGIC;
+            header.version = FORMAT_VERSION;
+            header.floatsPerVertex = FLOATS_PER_VERTEX;
+            header.depth = config.depth;
+            header.key = key(config);
+            header.vertexCount = vertices.size() / FLOATS_PER_VERTEX;
+            const bool withParents = !parents.empty() && parents.size() == header.vertexCount * PARENT_FLOATS_PER_VERTEX;
+            header.parentFloatsPerVertex = withParents ? PARENT_FLOATS_PER_VERTEX : 0;
+            file.write((const char *)&header, sizeof(header));
+            file.write((const char *)vertices.data(), header.vertexCount * FLOATS_PER_VERTEX * sizeof(float));
+            if (withParents)
+                file.write((const char *)parents.data(), parents.size() * sizeof(float));
+            if (!file)
+            {
+                std::cout << "WARNING::MESH_CACHE::CANNOT_WRITE: " << tmpPath << std::endl;
+                file.close();
+                std::filesystem::remove(tmpPath, ec);
+                return false;
+            }
+        }
+        std::filesystem::rename(tmpPath, finalPath, ec);
+        if (ec)
+        {
+            std::filesystem::remove(tmpPath, ec);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // unique per process and per call: <final>.<pid>.<n>.tmp
+    static std::string temporaryPath(const std::string &finalPath)
+    {
+        static std::atomic<unsigned> counter(0);
+#if defined(_WIN32)
+        long pid = (long)_getpid();
+#else
+        long pid = (long)getpid();
+#endif
+        return finalPath + "." + std::to_string(pid) + "." + std::to_string(counter++) + ".tmp";
+    }
+
+    static const uint32_t MAGIC = 0x434d544b; // "KTMC"
+    static const uint32_t FORMAT_VERSION = 2;
+    static const uint32_t FLOATS_PER_VERTEX = 6;
+    static const uint32_t PARENT_FLOATS_PER_VERTEX = 3;
+    // bump when ParentOutput changes what a vertex's parent is
+    static const uint32_t PARENT_LAYOUT = 1;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t floatsPerVertex;
+        uint32_t depth;
+        uint64_t key;
+        uint64_t vertexCount;
+        uint32_t parentFloatsPerVertex; // 0 when the entry has no parents
+        uint8_t reserved[28];
+    };
+    static_assert(sizeof(Header) == 64, "mesh cache header must stay 64 bytes");
+
+    static bool valid(const Header &header, uint64_t key, uint64_t fileSize)
+    {
+        return header.magic == MAGIC && header.version == FORMAT_VERSION &&
+               header.floatsPerVertex == FLOATS_PER_VERTEX && header.key == key &&
+               (header.parentFloatsPerVertex == 0 || header.parentFloatsPerVertex == PARENT_FLOATS_PER_VERTEX) &&
+               fileSize ==
+                   sizeof(Header) + header.vertexCount * (FLOATS_PER_VERTEX + header.parentFloatsPerVertex) * sizeof(float);
+    }
+
+    static std::string path(unsigned int depth)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "depth%u.ktmesh", depth);
+        return std::string(directory()) + "/" + name;
+    }
+};
+#endif
@@ -0,0 +1,445 @@
+#ifndef MESH_EXPORT_H
+#define MESH_EXPORT_H
+
+#include "koch_generator.h"
+#include "subtree_plan.h"
+#include "mesh_archive.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#define MESH_EXPORT_POSIX 1
+#endif
+
+// Streaming mesh exporters (binary STL, binary PLY, ASCII OBJ, the .ktz archive and the raw VBO dump). Every format
+// consumes the mesh chunk by chunk in generation order, so with generateMeshChunked a deep mesh is
+// written without ever being held in memory. Binary formats are written in host byte order and
+// assume a little-endian host, as both STL and our PLY header declare little-endian data.
+
+// Buffered output file: small writes are gathered in a large page-aligned buffer, and big
+// pre-formatted blocks go straight to the kernel with writev instead of being copied again.
+class FileSink
+{
+public:
+    static const size_t BUFFER_SIZE = 4 << 20;
+
+    FileSink() {}
+    FileSink(const FileSink &) = delete;
+    FileSink &operator=(const FileSink &) = delete;
+    ~FileSink() { close(); }
+
+    bool open(const std::string &outPath)
+    {
+        path = outPath;
+        storage.reset(new char[BUFFER_SIZE + 4096]);
+        buffer = storage.get() + (4096 - (uintptr_t)storage.get() % 4096) % 4096;
+        used = 0;
+        written = 0;
+        failed = false;
+#ifdef MESH_EXPORT_POSIX
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        isOpen = fd >= 0;
+#else
+        file = std::fopen(path.c_str(), "wb");
+        isOpen = file != NULL;
+#endif
+        if (!isOpen)
+            std::cout << "ERROR::EXPORT::FILE_NOT_WRITABLE: " << path << std::endl;
+        return isOpen;
+    }
+
+    void write(const void *data, size_t size)
+    {
+        if (size >= BUFFER_SIZE)
+        {
+            flush();
+            writeDirect((const char *)data, size);
+            return;
+        }
+        if (used + size > BUFFER_SIZE)
+            flush();
+        std::memcpy(buffer + used, data, size);
+        used += size;
+    }
+
+    // writes the blocks in order without copying them into the buffer
+    void writeBlocks(const std::vector<std::string> &blocks)
+    {
+        flush();
+#ifdef MESH_EXPORT_POSIX
+        std::vector<iovec> iov;
+        for (const std::string &block : blocks)
+            if (!block.empty())
+                iov.push_back({(void *)block.data(), block.size()});
+        size_t next = 0;
+        while (next < iov.size() && !failed)
+        {
+            int count = (int)std::min<size_t>(iov.size() - next, IOV_MAX);
+            ssize_t n = ::writev(fd, &iov[next], count);
+            if (n < 0)
+            {
+                fail();
+                return;
+            }
+            written += (unsigned long long)n;
+            // skip what went out completely, then finish a partially written block on its own
+            while (next < iov.size() && (size_t)n >= iov[next].iov_len)
+                n -= (ssize_t)iov[next++].iov_len;
+            if (n > 0)
+            {
+                writeDirect((const char *)iov[next].iov_base + n, iov[next].iov_len - (size_t)n);
+                ++next;
+            }
+        }
+#else
+        for (const std::string &block : blocks)
+            writeDirect(block.data(), block.size());
+#endif
+    }
+
+    void flush()
+    {
+        if (used)
+            writeDirect(buffer, used);
+        used = 0;
+    }
+
+    // flushes and closes; false if anything failed along the way
+    bool close()
+    {
+        if (!isOpen)
+            return !failed;
+        flush();
+#ifdef MESH_EXPORT_POSIX
+        if (::close(fd) != 0)
+            fail();
+#else
+        if (std::fclose(file) != 0)
+            fail();
+#endif
+        isOpen = false;
+        return !failed;
+    }
+
+    bool ok() const { return isOpen && !failed; }
+    unsigned long long bytes() const { return written + used; }
+
+private:
+    std::string path;
+    std::unique_ptr<char[]> storage;
+    char *buffer = NULL;
+    size_t used = 0;
+    unsigned long long written = 0;
+    bool isOpen = false;
+    bool failed = false;
+#ifdef MESH_EXPORT_POSIX
+    int fd = -1;
+#else
+    FILE *file = NULL;
+#endif
+
+    void writeDirect(const char *data, size_t size)
+    {
+        if (failed || !isOpen)
+            return;
+#ifdef MESH_EXPORT_POSIX
+        while (size)
+        {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0)
+            {
+                fail();
+                return;
+            }
+            data += n;
+            size -= (size_t)n;
+            written += (unsigned long long)n;
+        }
+#else
+        if (std::fwrite(data, 1, size, file) != size)
+            fail();
+        written += size;
+#endif
+    }
+
+    void fail()
+    {
+        if (!failed)
+            std::cout << "ERROR::EXPORT::WRITE_FAILED: " << path << std::endl;
+        failed = true;
+    }
+};
+
+// ASCII chunks at least this large are formatted on several threads
+const size_t parallelFormatTriangles = 1 << 14;
+
+// Formats triangles [0, triangles) of a chunk with format(first, last, text) split across the
+// hardware threads, and writes the pieces in order
+template <typename Format>
+void formatParallel(FileSink &sink, size_t triangles, Format format)
+{
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    if (triangles < parallelFormatTriangles || threads == 1)
+        threads = 1;
+    threads = (unsigned int)std::min<size_t>(threads, std::max<size_t>(1, triangles / 1024));
+    std::vector<std::string> blocks(threads);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        size_t first = triangles * t / threads, last = triangles * (t + 1) / threads;
+        if (t + 1 == threads)
+            format(first, last, blocks[t]);
+        else
+            workers.emplace_back([&format, &blocks, t, first, last] { format(first, last, blocks[t]); });
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+    sink.writeBlocks(blocks);
+}
+
+// shortest text that reads back as the same float
+inline char *appendFloat(char *out, char *end, float value)
+{
+    return std::to_chars(out, end, value).ptr;
+}
+
+inline char *appendIndex(char *out, char *end, unsigned long long value)
+{
+    return std::to_chars(out, end, value).ptr;
+}
+
+// per-format callbacks; chunk() receives whole triangles (18 floats each) and the index of the
+// chunk's first triangle in the mesh
+struct MeshFormat
+{
+    const char *name;
+    const char *extension;
+    bool (*header)(FileSink &sink, unsigned long long triangles, unsigned int depth);
+    void (*chunk)(FileSink &sink, const float *vertices, size_t triangles, unsigned long long firstTriangle);
+    void (*footer)(FileSink &sink, unsigned long long triangles);
+};
+
+// raw: the VBO contents verbatim (x y z r g b float32 per vertex), no header
+inline bool rawHeader(FileSink &, unsigned long long, unsigned int) { return true; }
+inline void rawChunk(FileSink &sink, const float *vertices, size_t triangles, unsigned long long)
+{
+    sink.write(vertices, triangles * 18 * sizeof(float));
+}
+inline void noFooter(FileSink &, unsigned long long) {}
+
+// binary STL: 80-byte header, uint32 count, then normal + 3 vertices + uint16 attribute per triangle
+inline bool stlHeader(FileSink &sink, unsigned long long triangles, unsigned int depth)
+{
+    if (triangles > 0xffffffffull)
+    {
+        std::cout << "ERROR::EXPORT::TOO_MANY_TRIANGLES_FOR_STL: " << triangles << std::endl;
+        return false;
+    }
+    char header[80] = {};
+    std::snprintf(header, sizeof(header), "Koch tetrahedron, depth %u", depth);
+    uint32_t count = (uint32_t)triangles;
+    sink.write(header, sizeof(header));
+    sink.write(&count, sizeof(count));
+    return true;
+}
+inline void stlChunk(FileSink &sink, const float *vertices, size_t triangles, unsigned long long)
+{
+    const size_t RECORD = 50;
+    char record[RECORD] = {};
+    for (size_t t = 0; t < triangles; ++t)
+    {
+        const float *a = vertices + t * 18, *b = a + 6, *c = a + 12;
+        float u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        float v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+        float n[3] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0]};
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0f)
+            for (float &x : n)
+                x /= length;
+        std::memcpy(record, n, 12);
+        std::memcpy(record + 12, a, 12);
+        std::memcpy(record + 24, b, 12);
+        std::memcpy(record + 36, c, 12);
+        sink.write(record, RECORD);
+    }
+}
+
+// binary PLY: float position and uchar colour per vertex, then one face per three vertices. The
+// faces only reference consecutive vertices, so they are written afterwards from the count alone.
+inline bool plyHeader(FileSink &sink, unsigned long long triangles, unsigned int depth)
+{
+    if (triangles * 3 > 0x7fffffffull)
+    {
+        std::cout << "ERROR::EXPORT::TOO_MANY_VERTICES_FOR_PLY: " << triangles * 3 << std::endl;
+        return false;
+    }
+    char header[512];
+    int length = std::snprintf(header, sizeof(header),
+                               "ply\nformat binary_little_endian 1.0\ncomment Koch tetrahedron, depth %u\n"
+                               "element vertex %llu\nproperty float x\nproperty float y\nproperty float z\n"
+                               "property uchar red\nproperty uchar green\nproperty uchar blue\n"
+                               "element face %llu\nproperty list uchar int vertex_indices\nend_header\n",
+                               depth, triangles * 3, triangles);
+    sink.write(header, (size_t)length);
+    return true;
+}
+inline void plyChunk(FileSink &sink, const float *vertices, size_t triangles, unsigned long long)
+{
+    char record[15];
+    for (size_t i = 0; i < triangles * 3; ++i)
+    {
+        const float *v = vertices + i * 6;
+        std::memcpy(record, v, 12);
+        for (int k = 0; k < 3; ++k)
+            record[12 + k] = (char)(unsigned char)std::lround(std::min(1.0f, std::max(0.0f, v[3 + k])) * 255.0f);
+        sink.write(record, sizeof(record));
+    }
+}
+inline void plyFooter(FileSink &sink, unsigned long long triangles)
+{
+    char record[13];
+    record[0] = 3;
+    for (unsigned long long t = 0; t < triangles; ++t)
+    {
+        int32_t index[3] = {(int32_t)(t * 3), (int32_t)(t * 3 + 1), (int32_t)(t * 3 + 2)};
+        std::memcpy(record + 1, index, sizeof(index));
+        sink.write(record, sizeof(record));
+    }
+}
+
+// ASCII OBJ with per-vertex colour ("v x y z r g b"); each triangle's face follows its vertices
+inline bool objHeader(FileSink &sink, unsigned long long, unsigned int depth)
+{
+    char header[64];
+    int length = std::snprintf(header, sizeof(header), "# Koch tetrahedron, depth %u\n", depth);
+    sink.write(header, (size_t)length);
+    return true;
+}
+inline void objChunk(FileSink &sink, const float *vertices, size_t triangles, unsigned long long firstTriangle)
+{
+    formatParallel(sink, triangles, [vertices, firstTriangle](size_t first, size_t last, std::string &text)
+                   {
+                       // a vertex line is at most 2 + 6 * 16 bytes, a face line 2 + 3 * 21
+                       const size_t PER_TRIANGLE = 3 * 100 + 70;
+                       text.resize((last - first) * PER_TRIANGLE);
+                       char *out = &text[0], *end = out + text.size();
+                       for (size_t t = first; t < last; ++t)
+                       {
+                           for (int k = 0; k < 3; ++k)
+                           {
+                               const float *v = vertices + t * 18 + k * 6;
+                               *out++ = 'v';
+                               for (int i = 0; i < 6; ++i)
+                               {
+                                   *out++ = ' ';
+                                   out = appendFloat(out, end, v[i]);
+                               }
+                               *out++ = '\n';
+                           }
+                           // OBJ indices are 1-based
+                           unsigned long long index = (firstTriangle + t) * 3 + 1;
+                           *out++ = 'f';
+                           for (int k = 0; k < 3; ++k)
+                           {
+                               *out++ = ' ';
+                               out = appendIndex(out, end, index + k);
+                           }
+                           *out++ = '\n';
+                       }
+                       text.resize(out - text.data());
+                   });
+}
+
+// compressed archive (mesh_archive.h): the header, then each chunk as independently decodable blocks
+inline bool archiveHeader(FileSink &sink, unsigned long long triangles, unsigned int depth)
+{
+    ArchiveHeader header = {ARCHIVE_MAGIC, ARCHIVE_VERSION, depth, 0, triangles};
+    sink.write(&header, sizeof(header));
+    return true;
+}
+
+inline void archiveChunk(FileSink &sink, const float *vertices, size_t triangles, unsigned long long)
+{
+    std::vector<std::string> blocks;
+    encodeArchiveBlocks(vertices, triangles, blocks);
+    sink.writeBlocks(blocks);
+}
+
+const MeshFormat meshFormats[] = {
+    {"raw", ".bin", rawHeader, rawChunk, noFooter},
+    {"stl", ".stl", stlHeader, stlChunk, noFooter},
+    {"ply", ".ply", plyHeader, plyChunk, plyFooter},
+    {"obj", ".obj", objHeader, objChunk, noFooter},
+    {"ktz", ".ktz", archiveHeader, archiveChunk, noFooter}};
+
+inline const MeshFormat *findMeshFormat(const std::string &name)
+{
+    for (const MeshFormat &format : meshFormats)
+        if (name == format.name)
+            return &format;
+    return NULL;
+}
+
+// by file extension, falling back to raw
+inline const MeshFormat &meshFormatForPath(const std::string &path)
+{
+    for (const MeshFormat &format : meshFormats)
+    {
+        size_t length = std::strlen(format.extension);
+        if (path.size() >= length && path.compare(path.size() - length, length, format.extension) == 0)
+            return format;
+    }
+    return meshFormats[0];
+}
+
+// triangles per chunk when streaming from the generator (~4.5 MB of vertex data)
+const unsigned long long exportChunkTriangles = 1 << 16;
+
+// exports an already generated mesh
+inline bool exportMesh(const MeshFormat &format, const std::string &path, const std::vector<float> &vertices,
+                       unsigned int depth)
+{
+    FileSink sink;
+    unsigned long long triangles = vertices.size() / 18;
+    if (!sink.open(path) || !format.header(sink, triangles, depth))
+        return false;
+    for (unsigned long long first = 0; first < triangles; first += exportChunkTriangles)
+        format.chunk(sink, vertices.data() + first * 18,
+                     (size_t)std::min(exportChunkTriangles, triangles - first), first);
+    format.footer(sink, triangles);
+    return sink.close();
+}
+
+// generates and exports chunk by chunk; onChunk(vertices, triangles) sees every chunk as it goes by
+template <typename OnChunk>
+bool exportMeshStreaming(const MeshFormat &format, const std::string &path, const KochGenerator &generator,
+                         OnChunk onChunk)
+{
+    FileSink sink;
+    unsigned long long triangles = generator.triangles();
+    if (!sink.open(path) || !format.header(sink, triangles, generator.depth()))
+        return false;
+    generateMeshChunked(generator, exportChunkTriangles,
+                        [&](const std::vector<float> &chunk, unsigned long long firstTriangle)
+                        {
+                            onChunk(chunk.data(), chunk.size() / 18);
+                            format.chunk(sink, chunk.data(), chunk.size() / 18, firstTriangle);
+                        });
+    format.footer(sink, triangles);
+    return sink.close();
+}
+#endif
@@ -0,0 +1,171 @@
+#ifndef OFFSCREEN_CONTEXT_H
+#define OFFSCREEN_CONTEXT_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <iostream>
+
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// An OpenGL 3.3 core context with no visible window, for the headless benchmark.
+//
+// On Linux this is plain EGL: the default display first, then Mesa's surfaceless platform,
+// which is what works on build machines without a display server (llvmpipe included). The
+// context is made current without a surface (EGL_KHR_surfaceless_context) or, failing that,
+// with a 1x1 pbuffer; either way the caller renders into its own framebuffer object.
+// Elsewhere it falls back to an invisible GLFW window.
+class OffscreenContext
+{
+public:
+    std::string description;
+
+    bool create()
+    {
+#if defined(__linux__)
+        if (createEGL())
+            return true;
+        std::cout << "EGL offscreen context unavailable, trying a hidden GLFW window" << std::endl;
+#endif
+        return createHiddenWindow();
+    }
+
+    GLADloadproc loader() const
+    {
+#if defined(__linux__)
+        if (display != EGL_NO_DISPLAY)
+            return (GLADloadproc)eglLoader;
+#endif
+        return (GLADloadproc)glfwGetProcAddress;
+    }
+
+    void destroy()
+    {
+#if defined(__linux__)
+        if (display != EGL_NO_DISPLAY)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (surface != EGL_NO_SURFACE)
+                eglDestroySurface(display, surface);
+            if (context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            eglTerminate(display);
+            display = EGL_NO_DISPLAY;
+        }
+#endif
+        if (window)
+        {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+            window = NULL;
+        }
+    }
+
+private:
+    GLFWwindow *window = NULL;
+
+    bool createHiddenWindow()
+    {
+        if (!glfwInit())
+            return false;
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = glfwCreateWindow(64, 64, "benchmark", NULL, NULL);
+        if (window == NULL)
+        {
+            glfwTerminate();
+            return false;
+        }
+        glfwMakeContextCurrent(window);
+        description = "hidden GLFW window";
+        return true;
+    }
+
+#if defined(__linux__)
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+
+    static void *eglLoader(const char *name)
+    {
+        return (void *)eglGetProcAddress(name);
+    }
+
+    bool createEGL()
+    {
+        if (tryDisplay(eglGetDisplay(EGL_DEFAULT_DISPLAY), "EGL default display"))
+            return true;
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay &&
+            tryDisplay(getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL),
+                       "EGL surfaceless platform"))
+            return true;
+        return false;
+    }
+
+    bool tryDisplay(EGLDisplay candidate, const char *name)
+    {
+        if (candidate == EGL_NO_DISPLAY)
+            return false;
+        EGLint major = 0, minor = 0;
+        if (!eglInitialize(candidate, &major, &minor))
+            return false;
+        display = candidate;
+
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+            EGL_DEPTH_SIZE, 24,
+            EGL_NONE};
+        EGLConfig config;
+        EGLint count = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &count) || count == 0 ||
+            !eglBindAPI(EGL_OPENGL_API))
+            return fail();
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE};
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT)
+            return fail();
+
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            const EGLint pbufferAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+            surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+            if (surface == EGL_NO_SURFACE || !eglMakeCurrent(display, surface, surface, context))
+                return fail();
+        }
+        description = name;
+        return true;
+    }
+
+    bool fail()
+    {
+        if (surface != EGL_NO_SURFACE)
+            eglDestroySurface(display, surface);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+        surface = EGL_NO_SURFACE;
+        context = EGL_NO_CONTEXT;
+        display = EGL_NO_DISPLAY;
+        return false;
+    }
+#endif
+};
+#endif
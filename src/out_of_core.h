@@ -0,0 +1,399 @@
+#ifndef OUT_OF_CORE_H
+#define OUT_OF_CORE_H
+
+#include "koch_generator.h"
+#include "subtree_plan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define OUT_OF_CORE_SUPPORTED 1
+#endif
+
+// Out-of-core generation for meshes far larger than RAM. The output is the raw vertex stream
+// (the same bytes `generate --out x.bin` and the VBO hold), pre-sized from triangleCount and
+// written subtree by subtree: each top-level subtree (subtree_plan.h) is generated into a
+// bounded buffer and copied into its own mapped window of the file at firstTriangle * 72.
+//
+// Finished subtrees are appended to a small text manifest next to the output, only after their
+// bytes have been synced, so after a crash or ^C rerunning the same command skips everything
+// the manifest lists and carries on with the rest:
+//
+//   ktooc 1 depth 10 split 3 tasks 864 bytes 62705664000
+//   done 17 9c1f0a2e4b6d8f10         (task index, FNV-1a of the task's bytes)
+struct OutOfCoreOptions
+{
+    std::string path;
+    unsigned int depth = defaultDepth;
+    unsigned int threads = 0;                        // 0: all hardware threads
+    unsigned long long subtreeTriangles = 1ull << 20; // upper bound per subtree (72 MB of vertices)
+};
+
+struct OutOfCoreStats
+{
+    unsigned long long tasks = 0, resumed = 0, generated = 0;
+    unsigned long long bytes = 0;
+};
+
+// 64-bit FNV-1a, also used to check merged shards against their manifests
+inline uint64_t meshChecksum(const void *data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// the manifest's first line; a manifest with any other header belongs to a different run
+inline std::string outOfCoreManifestHeader(unsigned int depth, int split, size_t tasks, unsigned long long bytes,
+                                           unsigned int shard = 0, unsigned int shards = 1)
+{
+    std::ostringstream header;
+    header << "ktooc 1 depth " << depth << " split " << split << " tasks " << tasks << " bytes " << bytes;
+    if (shards > 1)
+        header << " shard " << shard << "/" << shards;
+    return header.str();
+}
+
+// reads the completed tasks (index -> checksum) from a manifest; false if missing or not matching header
+inline bool readOutOfCoreManifest(const std::string &path, const std::string &header,
+                                  std::vector<char> &done, std::vector<uint64_t> &checksums)
+{
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line) || line != header)
+        return false;
+    while (std::getline(in, line))
+    {
+        unsigned long long index = 0, checksum = 0;
+        // a torn last line from a crash simply does not parse
+        if (std::sscanf(line.c_str(), "done %llu %llx", &index, &checksum) == 2 && index < done.size())
+        {
+            done[index] = 1;
+            checksums[index] = checksum;
+        }
+    }
+    return true;
+}
+
+#ifdef OUT_OF_CORE_SUPPORTED
+// writes one subtree into its window of the output; returns the checksum, or false on an I/O error
+inline bool writeSubtree(int fd, const KochGenerator &generator, const SubtreeTask &task, std::vector<float> &buffer,
+                         uint64_t &checksum)
+{
+    buffer.clear();
+    runSubtree(generator, task, buffer);
+    const size_t bytes = buffer.size() * sizeof(float);
+    const unsigned long long offset = task.firstTriangle * 18 * sizeof(float);
+    const unsigned long long page = (unsigned long long)sysconf(_SC_PAGESIZE);
+    const unsigned long long mapOffset = offset / page * page;
+    const size_t mapSize = (size_t)(offset - mapOffset) + bytes;
+    void *mapping = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)mapOffset);
+    if (mapping == MAP_FAILED)
+        return false;
+    std::memcpy((char *)mapping + (offset - mapOffset), buffer.data(), bytes);
+    // the manifest may only mention this subtree once its bytes are on disk
+    bool synced = msync(mapping, mapSize, MS_SYNC) == 0;
+    munmap(mapping, mapSize);
+    checksum = meshChecksum(buffer.data(), bytes);
+    return synced;
+}
+#endif
+
+// Generates the tasks of shard `shard` of `shards` (every shards-th task) into options.path,
+// resuming from the manifest at manifestPath when it belongs to the same run
+inline bool generateSubtreesToFile(const OutOfCoreOptions &options, const std::string &manifestPath,
+                                   unsigned int shard, unsigned int shards, OutOfCoreStats &stats)
+{
+#ifdef OUT_OF_CORE_SUPPORTED
+    const KochGenerator generator(options.depth);
+    const int split = splitDepthFor(options.depth, options.subtreeTriangles);
+    const std::vector<SubtreeTask> tasks = planSubtrees(generator, split);
+    const unsigned long long bytes = triangleCount(options.depth) * 18 * sizeof(float);
+    const std::string header = outOfCoreManifestHeader(options.depth, split, tasks.size(), bytes, shard, shards);
+    stats = OutOfCoreStats();
+    stats.bytes = bytes;
+
+    std::vector<char> done(tasks.size(), 0);
+    std::vector<uint64_t> checksums(tasks.size(), 0);
+    struct stat info;
+    bool resuming = stat(options.path.c_str(), &info) == 0 && (unsigned long long)info.st_size == bytes &&
+                    readOutOfCoreManifest(manifestPath, header, done, checksums);
+    if (!resuming)
+        std::fill(done.begin(), done.end(), 0);
+
+    int fd = open(options.path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        std::cout << "ERROR::OUT_OF_CORE::FILE_NOT_WRITABLE: " << options.path << std::endl;
+        return false;
+    }
+    // reserve the blocks up front, so a full disk fails here and not as SIGBUS mid-run. Existing
+    // contents are kept: every byte is rewritten anyway, and with --shard other processes are
+    // filling their own ranges of the same file at the same time
+#if defined(__linux__)
+    int reserved = posix_fallocate(fd, 0, (off_t)bytes);
+#else
+    int reserved = fstat(fd, &info) == 0 && (unsigned long long)info.st_size >= bytes ? 0 : ftruncate(fd, (off_t)bytes);
+#endif
+    if (reserved == 0 && fstat(fd, &info) == 0 && (unsigned long long)info.st_size > bytes)
+        reserved = ftruncate(fd, (off_t)bytes);
+    if (reserved != 0)
+    {
+        std::cout << "ERROR::OUT_OF_CORE::CANNOT_RESERVE: " << bytes << " bytes for " << options.path << std::endl;
+        close(fd);
+        return false;
+    }
+    FILE *manifest = std::fopen(manifestPath.c_str(), resuming ? "a" : "w");
+    if (!manifest)
+    {
+        std::cout << "ERROR::OUT_OF_CORE::FILE_NOT_WRITABLE: " << manifestPath << std::endl;
+        close(fd);
+        return false;
+    }
+    if (!resuming)
+    {
+        std::fprintf(manifest, "%s\n", header.c_str());
+        std::fflush(manifest);
+    }
+
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        if (i % shards != shard)
+            continue;
+        ++stats.tasks;
+        if (done[i])
+            ++stats.resumed;
+        else
+            pending.push_back(i);
+    }
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::mutex manifestMutex;
+    unsigned int threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned int)std::min<size_t>(threads, std::max<size_t>(1, pending.size()));
+    auto work = [&]
+    {
+        std::vector<float> buffer;
+        for (size_t n = next++; n < pending.size() && !failed; n = next++)
+        {
+            size_t index = pending[n];
+            uint64_t checksum = 0;
+            if (!writeSubtree(fd, generator, tasks[index], buffer, checksum))
+            {
+                failed = true;
+                break;
+            }
+            std::lock_guard<std::mutex> lock(manifestMutex);
+            std::fprintf(manifest, "done %zu %016llx\n", index, (unsigned long long)checksum);
+            std::fflush(manifest);
+            fsync(fileno(manifest));
+            ++stats.generated;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; ++t)
+        workers.emplace_back(work);
+    work();
+    for (std::thread &worker : workers)
+        worker.join();
+
+    std::fclose(manifest);
+    close(fd);
+    if (failed)
+        std::cout << "ERROR::OUT_OF_CORE::WRITE_FAILED: " << options.path << " (rerun to resume)" << std::endl;
+    return !failed;
+#else
+    (void)options;
+    (void)manifestPath;
+    (void)shard;
+    (void)shards;
+    (void)stats;
+    std::cout << "ERROR::OUT_OF_CORE::UNSUPPORTED: needs mmap" << std::endl;
+    return false;
+#endif
+}
+
+inline std::string outOfCoreManifestPath(const std::string &path) { return path + ".manifest"; }
+
+// the whole mesh into options.path, resuming a previous interrupted run
+inline bool generateOutOfCore(const OutOfCoreOptions &options, OutOfCoreStats &stats)
+{
+    return generateSubtreesToFile(options, outOfCoreManifestPath(options.path), 0, 1, stats);
+}
+
+// Sharded generation (--shard i/N): N processes, possibly on several machines sharing the output
+// file, each generate every N-th subtree into that subtree's byte range of the same pre-sized
+// file and keep their own manifest. The split is derived from depth and N alone so every shard
+// plans the same subtrees; it aims for at least 8 subtrees per shard to even out the work.
+inline OutOfCoreOptions shardOptions(const OutOfCoreOptions &options, unsigned int shards)
+{
+    OutOfCoreOptions sharded = options;
+    unsigned long long perTask = triangleCount(options.depth) / (8ull * shards);
+    sharded.subtreeTriangles = std::max(1ull, std::min(options.subtreeTriangles, perTask));
+    return sharded;
+}
+
+inline std::string shardManifestPath(const std::string &path, unsigned int shard, unsigned int shards)
+{
+    return path + ".shard-" + std::to_string(shard) + "-of-" + std::to_string(shards) + ".manifest";
+}
+
+// "i/N" with i < N
+inline bool parseShard(const char *text, unsigned int &shard, unsigned int &shards)
+{
+    return std::sscanf(text, "%u/%u", &shard, &shards) == 2 && shards > 0 && shard < shards;
+}
+
+inline bool generateShard(const OutOfCoreOptions &options, unsigned int shard, unsigned int shards,
+                          OutOfCoreStats &stats)
+{
+    return generateSubtreesToFile(shardOptions(options, shards), shardManifestPath(options.path, shard, shards),
+                                  shard, shards, stats);
+}
+
+// Checks a sharded run: every shard manifest must belong to this run and list all of its subtrees,
+// and every subtree's bytes in the output must still match the checksum its shard recorded.
+// On success the combined manifest is written, so the file then looks like a finished
+// out-of-core run. That manifest uses the split a plain run would (shards split finer, see
+// shardOptions); each of its subtrees covers a run of consecutive shard subtrees, so its checksum
+// is chained through the same pass that verifies them.
+inline bool mergeShards(const OutOfCoreOptions &options, unsigned int shards, unsigned long long &verifiedBytes)
+{
+    verifiedBytes = 0;
+#ifdef OUT_OF_CORE_SUPPORTED
+    const OutOfCoreOptions sharded = shardOptions(options, shards);
+    const int split = splitDepthFor(sharded.depth, sharded.subtreeTriangles);
+    const std::vector<SubtreeTask> tasks = planSubtrees(KochGenerator(sharded.depth), split);
+    const unsigned long long bytes = triangleCount(sharded.depth) * 18 * sizeof(float);
+    const int plainSplit = splitDepthFor(options.depth, options.subtreeTriangles);
+    const std::vector<SubtreeTask> plainTasks =
+        plainSplit == split ? tasks : planSubtrees(KochGenerator(options.depth), plainSplit);
+    // the shard subtrees [groups[j], groups[j + 1]) make up plain subtree j
+    std::vector<size_t> groups(1, 0);
+    for (size_t i = 0; i < tasks.size() && groups.size() <= plainTasks.size(); ++i)
+        if (tasks[i].firstTriangle + tasks[i].triangles ==
+            plainTasks[groups.size() - 1].firstTriangle + plainTasks[groups.size() - 1].triangles)
+            groups.push_back(i + 1);
+    if (groups.size() != plainTasks.size() + 1)
+    {
+        std::cout << "ERROR::MERGE::SPLIT_MISMATCH: shard subtrees do not nest in depth " << plainSplit
+                  << " subtrees" << std::endl;
+        return false;
+    }
+
+    std::vector<char> done(tasks.size(), 0);
+    std::vector<uint64_t> checksums(tasks.size(), 0);
+    for (unsigned int shard = 0; shard < shards; ++shard)
+    {
+        std::string manifestPath = shardManifestPath(options.path, shard, shards);
+        std::vector<char> shardDone(tasks.size(), 0);
+        if (!readOutOfCoreManifest(manifestPath,
+                                   outOfCoreManifestHeader(sharded.depth, split, tasks.size(), bytes, shard, shards),
+                                   shardDone, checksums))
+        {
+            std::cout << "ERROR::MERGE::MANIFEST_MISSING_OR_MISMATCHED: " << manifestPath << std::endl;
+            return false;
+        }
+        for (size_t i = shard; i < tasks.size(); i += shards)
+            if (!shardDone[i])
+            {
+                std::cout << "ERROR::MERGE::SHARD_INCOMPLETE: shard " << shard << " has not finished subtree " << i
+                          << std::endl;
+                return false;
+            }
+            else
+                done[i] = 1;
+    }
+
+    int fd = open(options.path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || (unsigned long long)info.st_size != bytes)
+    {
+        std::cout << "ERROR::MERGE::OUTPUT_MISSING_OR_WRONG_SIZE: " << options.path << std::endl;
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    std::vector<uint64_t> plainChecksums(plainTasks.size(), 0);
+    std::atomic<size_t> next(0);
+    std::atomic<bool> mismatch(false);
+    std::atomic<unsigned long long> verified(0);
+    auto work = [&]
+    {
+        const unsigned long long page = (unsigned long long)sysconf(_SC_PAGESIZE);
+        for (size_t j = next++; j < plainTasks.size() && !mismatch; j = next++)
+        {
+            uint64_t chained = meshChecksum(NULL, 0);
+            for (size_t i = groups[j]; i < groups[j + 1] && !mismatch; ++i)
+            {
+                unsigned long long offset = tasks[i].firstTriangle * 18 * sizeof(float);
+                size_t size = (size_t)(tasks[i].triangles * 18 * sizeof(float));
+                unsigned long long mapOffset = offset / page * page;
+                size_t mapSize = (size_t)(offset - mapOffset) + size;
+                void *mapping = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, (off_t)mapOffset);
+                const char *data = mapping == MAP_FAILED ? NULL : (const char *)mapping + (offset - mapOffset);
+                if (!data || meshChecksum(data, size) != checksums[i])
+                {
+                    std::cout << "ERROR::MERGE::CHECKSUM_MISMATCH: subtree " << i << " (bytes " << offset << "+"
+                              << size << ")" << std::endl;
+                    mismatch = true;
+                }
+                else if (plainSplit != split)
+                    chained = meshChecksum(data, size, chained);
+                if (data)
+                    munmap(mapping, mapSize);
+                verified += size;
+            }
+            plainChecksums[j] = plainSplit == split ? checksums[groups[j]] : chained;
+        }
+    };
+    unsigned int threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; ++t)
+        workers.emplace_back(work);
+    work();
+    for (std::thread &worker : workers)
+        worker.join();
+    close(fd);
+    verifiedBytes = verified;
+    if (mismatch)
+        return false;
+
+    std::ofstream manifest(outOfCoreManifestPath(options.path), std::ios::trunc);
+    manifest << outOfCoreManifestHeader(options.depth, plainSplit, plainTasks.size(), bytes) << "\n";
+    for (size_t j = 0; j < plainTasks.size(); ++j)
+    {
+        char line[64];
+        std::snprintf(line, sizeof(line), "done %zu %016llx\n", j, (unsigned long long)plainChecksums[j]);
+        manifest << line;
+    }
+    return (bool)manifest;
+#else
+    (void)options;
+    (void)shards;
+    std::cout << "ERROR::OUT_OF_CORE::UNSUPPORTED: needs mmap" << std::endl;
+    return false;
+#endif
+}
+#endif
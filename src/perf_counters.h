@@ -0,0 +1,187 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// Hardware/software performance counters for the calling thread (and threads it spawns while
+// counting) via Linux perf_event_open.
+//
+// Each counter is opened on its own rather than as a group, so one event the PMU (or a
+// container's seccomp/perf_event_paranoid policy) refuses does not take the others down with
+// it; unavailable counters simply report "n/a". Values are scaled by time_enabled/time_running
+// in case the kernel had to multiplex them. On other platforms nothing is counted.
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        INSTRUCTIONS,
+        CYCLES,
+        CACHE_MISSES,
+        BRANCH_MISSES,
+        PAGE_FAULTS,
+        COUNTER_COUNT
+    };
+
+    struct Sample
+    {
+        bool valid[COUNTER_COUNT] = {};
+        double value[COUNTER_COUNT] = {};
+    };
+
+    PerfCounters()
+    {
+#if defined(__linux__)
+        const struct
+        {
+            uint32_t type;
+            uint64_t config;
+        } events[COUNTER_COUNT] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS}};
+        for (int i = 0; i < COUNTER_COUNT; ++i)
+        {
+            struct perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].type;
+            attr.config = events[i].config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1; // also what perf_event_paranoid=2 allows unprivileged
+            attr.exclude_hv = 1;
+            attr.inherit = 1; // include worker threads spawned while counting (parallel engines)
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#if defined(__linux__)
+        for (int fd : fds)
+            if (fd >= 0)
+                close(fd);
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool available() const
+    {
+        for (int fd : fds)
+            if (fd >= 0)
+                return true;
+        return false;
+    }
+
+    void start()
+    {
+#if defined(__linux__)
+        for (int fd : fds)
+            if (fd >= 0)
+            {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+    }
+
+    Sample stop()
+    {
+        Sample sample;
+#if defined(__linux__)
+        for (int i = 0; i < COUNTER_COUNT; ++i)
+        {
+            if (fds[i] < 0)
+                continue;
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t data[3] = {0, 0, 0}; // value, time enabled, time running
+            if (read(fds[i], data, sizeof(data)) != (ssize_t)sizeof(data) || data[2] == 0)
+                continue;
+            sample.valid[i] = true;
+            sample.value[i] = data[2] < data[1] ? (double)data[0] * data[1] / data[2] : (double)data[0];
+        }
+#endif
+        return sample;
+    }
+
+    static const char *name(int counter)
+    {
+        static const char *names[COUNTER_COUNT] = {"instructions", "cycles", "cache-misses", "branch-misses", "page-faults"};
+        return names[counter];
+    }
+
+private:
+    int fds[COUNTER_COUNT] = {-1, -1, -1, -1, -1};
+};
+
+// Collects one counter sample per phase and prints them normalized per triangle
+class PerfReport
+{
+public:
+    void add(const std::string &phase, const PerfCounters::Sample &sample, unsigned long long triangles)
+    {
+        rows.push_back({phase, sample, triangles});
+    }
+
+    void print(std::ostream &out) const
+    {
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-24s %12s", "phase (per triangle)", "triangles");
+        out << line;
+        for (int c = 0; c < PerfCounters::COUNTER_COUNT; ++c)
+        {
+            std::snprintf(line, sizeof(line), " %14s", PerfCounters::name(c));
+            out << line;
+        }
+        std::snprintf(line, sizeof(line), " %8s\n", "IPC");
+        out << line;
+        for (const Row &row : rows)
+        {
+            std::snprintf(line, sizeof(line), "%-24s %12llu", row.phase.c_str(), row.triangles);
+            out << line;
+            for (int c = 0; c < PerfCounters::COUNTER_COUNT; ++c)
+            {
+                if (row.sample.valid[c] && row.triangles)
+                    std::snprintf(line, sizeof(line), " %14.2f", row.sample.value[c] / row.triangles);
+                else
+                    std::snprintf(line, sizeof(line), " %14s", "n/a");
+                out << line;
+            }
+            const PerfCounters::Sample &s = row.sample;
+            if (s.valid[PerfCounters::INSTRUCTIONS] && s.valid[PerfCounters::CYCLES] && s.value[PerfCounters::CYCLES] > 0)
+                std::snprintf(line, sizeof(line), " %8.2f\n", s.value[PerfCounters::INSTRUCTIONS] / s.value[PerfCounters::CYCLES]);
+            else
+                std::snprintf(line, sizeof(line), " %8s\n", "n/a");
+            out << line;
+        }
+        out.flush();
+    }
+
+private:
+    struct Row
+    {
+        std::string phase;
+        PerfCounters::Sample sample;
+        unsigned long long triangles;
+    };
+    std::vector<Row> rows;
+};
+#endif
@@ -0,0 +1,395 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+// Frame profiler for the render thread.
+//
+// CPU phases are timed with steady_clock (or fed in from elsewhere via addCpuSample, e.g. the
+// input thread's sampling cost travelling in the frame snapshot). GPU passes are timed with
+// GL_TIME_ELAPSED queries kept in a ring of QUERY_FRAMES frames, so a frame's results are read
+// back a couple of frames later once they are available and the CPU never waits on the GPU.
+// Every metric keeps a rolling window of samples from which the percentiles are computed.
+class FrameProfiler
+{
+public:
+    static const size_t WINDOW = 1024;       // samples kept per metric for percentiles
+    static const size_t QUERY_FRAMES = 4;    // frames of GPU queries in flight
+
+    bool enabled = false;
+
+    struct Metric
+    {
+        std::string name;
+        bool gpu = false;
+        std::vector<float> samples; // milliseconds, ring of WINDOW entries
+        size_t next = 0;
+        size_t count = 0;
+
+        void add(float ms)
+        {
+            if (samples.size() < WINDOW)
+                samples.push_back(ms);
+            else
+                samples[next] = ms;
+            next = (next + 1) % WINDOW;
+            ++count;
+        }
+        // most recent sample, or 0 if none yet
+        float last() const
+        {
+            if (samples.empty())
+                return 0.0f;
+            return samples[(next + WINDOW - 1) % WINDOW % samples.size()];
+        }
+        // i-th most recent sample (0 = newest)
+        float recent(size_t i) const
+        {
+            if (i >= samples.size())
+                return 0.0f;
+            return samples[(next + 2 * WINDOW - 1 - i) % WINDOW % samples.size()];
+        }
+    };
+
+    // registration; returns the id used by the timing calls
+    int addCpuPhase(const std::string &name) { return addMetric(name, false); }
+    int addGpuPass(const std::string &name) { return addMetric(name, true); }
+
+    void beginFrame()
+    {
+        if (!enabled)
+            return;
+        frameStart = now();
+        collectGpu();
+    }
+
+    void endFrame()
+    {
+        if (!enabled)
+            return;
+        metrics[frameMetric].add(elapsedMs(frameStart));
+        queryFrame = (queryFrame + 1) % QUERY_FRAMES;
+        ++frames;
+    }
+
+    // read back every query whose result has arrived; never blocks
+    void collectGpu()
+    {
+        for (size_t m = 0; m < metrics.size(); ++m)
+        {
+            if (!metrics[m].gpu)
+                continue;
+            for (size_t f = 0; f < QUERY_FRAMES; ++f)
+            {
+                GpuSlot &slot = gpuSlot((int)m, f);
+                if (!slot.inFlight)
+                    continue;
+                GLint available = 0;
+                glGetQueryObjectiv(slot.query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    continue;
+                GLuint64 ns = 0;
+                glGetQueryObjectui64v(slot.query, GL_QUERY_RESULT, &ns);
+                metrics[m].add((float)(ns * 1e-6));
+                slot.inFlight = false;
+            }
+        }
+    }
+
+    void beginCpu(int phase)
+    {
+        if (enabled)
+            cpuStart[phase] = now();
+    }
+    void endCpu(int phase)
+    {
+        if (enabled)
+            metrics[phase].add(elapsedMs(cpuStart[phase]));
+    }
+    void addCpuSample(int phase, double seconds)
+    {
+        if (enabled)
+            metrics[phase].add((float)(seconds * 1000.0));
+    }
+
+    // GL_TIME_ELAPSED queries cannot nest, so passes must not overlap
+    void beginGpu(int pass)
+    {
+        if (!enabled)
+            return;
+        GpuSlot &slot = gpuSlot(pass, queryFrame);
+        if (slot.query == 0)
+            glGenQueries(1, &slot.query);
+        if (slot.inFlight)
+            return; // results from QUERY_FRAMES ago still not back; skip rather than stall
+        glBeginQuery(GL_TIME_ELAPSED, slot.query);
+        slot.inFlight = true;
+        activeSlot = &slot;
+        activePass = pass;
+    }
+    // pass must be the one given to the matching beginGpu
+    void endGpu(int pass)
+    {
+        if (!enabled || !activeSlot)
+            return;
+        if (pass != activePass)
+            std::cout << "ERROR::PROFILER::PASS_MISMATCH: ended " << metrics[pass].name << " while timing "
+                      << metrics[activePass].name << std::endl;
+        // the one open query is ended either way, so the next pass can begin
+        glEndQuery(GL_TIME_ELAPSED);
+        activeSlot = nullptr;
+    }
+
+    const std::vector<Metric> &all() const { return metrics; }
+
+    // clears every metric's window (GPU queries still in flight keep their slots)
+    void reset()
+    {
+        for (Metric &metric : metrics)
+        {
+            metric.samples.clear();
+            metric.next = 0;
+            metric.count = 0;
+        }
+        frames = 0;
+    }
+
+    // p in [0, 1] over the metric's current window
+    float percentile(int metric, double p) const
+    {
+        std::vector<float> sorted(metrics[metric].samples);
+        if (sorted.empty())
+            return 0.0f;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[std::min(sorted.size() - 1, (size_t)(p * (sorted.size() - 1) + 0.5))];
+    }
+    int frameTotal() const { return frameMetric; }
+
+    // writes the percentiles as JSON if the path ends in .json, CSV otherwise
+    void dump(const std::string &path) const
+    {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file)
+        {
+            std::cout << "ERROR::PROFILER::CANNOT_WRITE: " << path << std::endl;
+            return;
+        }
+        bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+        char line[256];
+        if (json)
+            file << "{\n  \"frames\": " << frames << ",\n  \"metrics\": [\n";
+        else
+            file << "metric,kind,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+        for (size_t i = 0; i < metrics.size(); ++i)
+        {
+            Summary s = summarize(metrics[i]);
+            const char *kind = metrics[i].gpu ? "gpu" : "cpu";
+            if (json)
+                std::snprintf(line, sizeof(line),
+                              "    {\"name\": \"%s\", \"kind\": \"%s\", \"samples\": %zu, \"mean_ms\": %.4f, "
+                              "\"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f}%s\n",
+                              metrics[i].name.c_str(), kind, s.samples, s.mean, s.p50, s.p95, s.p99, s.max,
+                              i + 1 < metrics.size() ? "," : "");
+            else
+                std::snprintf(line, sizeof(line), "%s,%s,%zu,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+                              metrics[i].name.c_str(), kind, s.samples, s.mean, s.p50, s.p95, s.p99, s.max);
+            file << line;
+        }
+        if (json)
+            file << "  ]\n}\n";
+        std::cout << "profile written to " << path << std::endl;
+    }
+
+    // one line per metric on the console
+    void print(std::ostream &out) const
+    {
+        char line[160];
+        for (const Metric &metric : metrics)
+        {
+            Summary s = summarize(metric);
+            std::snprintf(line, sizeof(line), "%-10s %s  p50 %7.3f ms  p99 %7.3f ms  max %7.3f ms",
+                          metric.name.c_str(), metric.gpu ? "gpu" : "cpu", s.p50, s.p99, s.max);
+            out << line << "\n";
+        }
+        out.flush();
+    }
+
+    // render thread, with the context current
+    void destroy()
+    {
+        for (GpuSlot &slot : gpuSlots)
+            if (slot.query)
+                glDeleteQueries(1, &slot.query);
+        gpuSlots.clear();
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct GpuSlot
+    {
+        GLuint query = 0;
+        bool inFlight = false;
+    };
+    struct Summary
+    {
+        size_t samples = 0;
+        float mean = 0, p50 = 0, p95 = 0, p99 = 0, max = 0;
+    };
+
+    std::vector<Metric> metrics;
+    std::vector<Clock::time_point> cpuStart;
+    std::vector<GpuSlot> gpuSlots; // [metric][QUERY_FRAMES]
+    GpuSlot *activeSlot = nullptr;
+    int activePass = -1;
+    Clock::time_point frameStart;
+    size_t queryFrame = 0;
+    unsigned long long frames = 0;
+    int frameMetric = addMetric("frame", false);
+
+    int addMetric(const std::string &name, bool gpu)
+    {
+        Metric metric;
+        metric.name = name;
+        metric.gpu = gpu;
+        metrics.push_back(metric);
+        cpuStart.resize(metrics.size());
+        gpuSlots.resize(metrics.size() * QUERY_FRAMES);
+        activeSlot = nullptr;
+        return (int)metrics.size() - 1;
+    }
+
+    GpuSlot &gpuSlot(int pass, size_t frame) { return gpuSlots[pass * QUERY_FRAMES + frame]; }
+
+    static Clock::time_point now() { return Clock::now(); }
+    static float elapsedMs(Clock::time_point start)
+    {
+        return std::chrono::duration<float, std::milli>(now() - start).count();
+    }
+
+    static Summary summarize(const Metric &metric)
+    {
+        Summary s;
+        std::vector<float> sorted(metric.samples);
+        s.samples = sorted.size();
+        if (sorted.empty())
+            return s;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (float v : sorted)
+            total += v;
+        auto at = [&sorted](double p)
+        { return sorted[std::min(sorted.size() - 1, (size_t)(p * (sorted.size() - 1) + 0.5))]; };
+        s.mean = (float)(total / sorted.size());
+        s.p50 = at(0.50);
+        s.p95 = at(0.95);
+        s.p99 = at(0.99);
+        s.max = sorted.back();
+        return s;
+    }
+};
+
+// Stacked frame-time bars in the bottom-left corner: one column per recent frame, CPU phases
+// stacked on the left half of each column and GPU passes on the right half, with a marker line
+// at 16.7 ms. Drawn in NDC with its own tiny program (overlay.vs / overlay.fs).
+class ProfilerOverlay
+{
+public:
+    static const int COLUMNS = 120;
+
+    void init()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        // position attribute
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
+        glEnableVertexAttribArray(0);
+        // color attribute
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(2 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+    }
+
+    // program must be the overlay variant; leaves depth testing and fill mode as it found them
+    void draw(const FrameProfiler &profiler, unsigned int program)
+    {
+        vertices.clear();
+        const float left = -0.98f, bottom = -0.98f, width = 0.9f, height = 0.4f;
+        const float scaleMs = 33.3f; // full overlay height
+        const float column = width / COLUMNS;
+        const std::vector<FrameProfiler::Metric> &metrics = profiler.all();
+
+        for (int c = 0; c < COLUMNS; ++c)
+        {
+            size_t age = COLUMNS - 1 - c;
+            float x = left + c * column;
+            float cpuY = bottom, gpuY = bottom;
+            for (size_t m = 0; m < metrics.size(); ++m)
+            {
+                if ((int)m == profiler.frameTotal())
+                    continue;
+                float ms = metrics[m].recent(age);
+                float h = std::min(ms / scaleMs, 1.0f) * height;
+                const float *color = palette[m % PALETTE_SIZE];
+                if (metrics[m].gpu)
+                {
+                    quad(x + column * 0.5f, gpuY, column * 0.45f, h, color);
+                    gpuY += h;
+                }
+                else
+                {
+                    quad(x, cpuY, column * 0.45f, h, color);
+                    cpuY += h;
+                }
+            }
+        }
+        const float white[3] = {1.0f, 1.0f, 1.0f};
+        quad(left, bottom + (16.7f / scaleMs) * height, width, 0.004f, white);
+
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        glDisable(GL_DEPTH_TEST);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glUseProgram(program);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STREAM_DRAW);
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(vertices.size() / 5));
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+    }
+
+    void destroy()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+    }
+
+private:
+    static const int PALETTE_SIZE = 6;
+    const float palette[PALETTE_SIZE][3] = {
+        {0.90f, 0.30f, 0.30f}, {0.30f, 0.80f, 0.30f}, {0.30f, 0.50f, 0.95f},
+        {0.95f, 0.85f, 0.25f}, {0.80f, 0.40f, 0.90f}, {0.30f, 0.85f, 0.85f}};
+    unsigned int VAO = 0, VBO = 0;
+    std::vector<float> vertices;
+
+    void quad(float x, float y, float w, float h, const float *color)
+    {
+        const float corners[6][2] = {{x, y}, {x + w, y}, {x + w, y + h}, {x, y}, {x + w, y + h}, {x, y + h}};
+        for (const auto &corner : corners)
+        {
+            vertices.insert(vertices.end(), corner, corner + 2);
+            vertices.insert(vertices.end(), color, color + 3);
+        }
+    }
+};
+#endif
@@ -0,0 +1,169 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+// Entries are keyed by a hash of the shader sources and the vendor/renderer/version
+// strings, so a driver update or a shader edit simply misses instead of loading stale code.
+// Drivers may still reject a binary (e.g. after an update that kept the version string);
+// callers then recompile from source and store a fresh entry.
+class ProgramBinaryCache
+{
+public:
+    static const char *directory() { return "shader_cache"; }
+
+    // program binaries need GL 4.1 and at least one binary format. ARB_get_program_binary has the
+    // same entry points, but glad here was generated without extensions and only loads them with
+    // the 4.1 core, so on an older context the cache stays off even where the extension exists.
+    static bool supported()
+    {
+        if (!GLAD_GL_VERSION_4_1 || !glGetProgramBinary || !glProgramBinary)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    // 64-bit FNV-1a over the sources and the driver identity
+    static uint64_t key(const std::string &vertexCode, const std::string &fragmentCode)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const char *data, size_t size)
+        {
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash ^= (unsigned char)data[i];
+                hash *= 1099511628211ull;
+            }
+            hash ^= 0xff; // field separator so "ab"+"c" and "a"+"bc" differ
+            hash *= 1099511628211ull;
+        };
+        auto mixGLString = [&mix](GLenum name)
+        {
+            const char *value = (const char *)glGetString(name);
+            if (value)
+                mix(value, std::char_traits<char>::length(value));
+        };
+        const uint32_t version = FORMAT_VERSION;
+        mix((const char *)&version, sizeof(version));
+        mix(vertexCode.data(), vertexCode.size());
+        mix(fragmentCode.data(), fragmentCode.size());
+        mixGLString(GL_VENDOR);
+        mixGLString(GL_RENDERER);
+        mixGLString(GL_VERSION);
+        return hash;
+    }
+
+    // loads the cached binary into program; returns false on a miss or if the driver rejects it
+    static bool load(GLuint program, uint64_t key)
+    {
+        std::ifstream file(path(key), std::ios::binary);
+        if (!file)
+            return false;
+        Header header;
+        if (!file.read((char *)&header, sizeof(header)) || header.magic != MAGIC ||
+            header.version != FORMAT_VERSION || header.key != key || header.length == 0)
+            return false;
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), binary.size()))
+            return false;
+
+        glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        return success == GL_TRUE;
+    }
+
+    // writes the linked program to the cache. The program must have been linked with
+    // GL_PROGRAM_BINARY_RETRIEVABLE_HINT set, otherwise some drivers return nothing.
+    static void store(GLuint program, uint64_t key)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &format, binary.data());
+        if (written <= 0)
+            return;
+
+        std::error_code ec;
+        std::filesystem::create_directories(directory(), ec);
+        // write to a temporary of this writer's own and rename, so a concurrent launch never
+        // reads a torn entry
+        std::string finalPath = path(key);
+        std::string tmpPath = temporaryPath(finalPath);
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                std::cout << "WARNING::PROGRAM_CACHE::CANNOT_WRITE: " << tmpPath << std::endl;
+                return;
+            }
+            Header header{MAGIC, FORMAT_VERSION, format, (uint32_t)written, key};
+            file.write((const char *)&header, sizeof(header));
+            file.write(binary.data(), written);
+            if (!file)
+            {
+                std::cout << "WARNING::PROGRAM_CACHE::CANNOT_WRITE: " << tmpPath << std::endl;
+                file.close();
+                std::filesystem::remove(tmpPath, ec);
+                return;
+            }
+        }
+        std::filesystem::rename(tmpPath, finalPath, ec);
+        if (ec)
+            std::filesystem::remove(tmpPath, ec);
+    }
+
+private:
+    // unique per process and per call: <final>.<pid>.<n>.tmp
+    static std::string temporaryPath(const std::string &finalPath)
+    {
+        static std::atomic<unsigned> counter(0);
+#if defined(_WIN32)
+        long pid = (long)_getpid();
+#else
+        long pid = (long)getpid();
+#endif
+        return finalPath + "." + std::to_string(pid) + "." + std::to_string(counter++) + ".tmp";
+    }
+
+    static const uint32_t MAGIC = 0x4250544b; // "KTPB"
+    static const uint32_t FORMAT_VERSION = 1;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t format;
+        uint32_t length;
+        uint64_t key;
+    };
+
+    static std::string path(uint64_t key)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return std::string(directory()) + "/" + name;
+    }
+};
+#endif
@@ -0,0 +1,253 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader_s.h"
+#include "shader_library.h"
+#include "uniform_buffer.h"
+#include "profiler.h"
+#include "camera.h"
+#include "koch_generator.h"
+#include "gpu_mesh_cache.h"
+#include "trace.h"
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+
+// render modes, cycled with M; each one draws with its own shader variant
+struct RenderMode
+{
+    const char *name;
+    const char *variant;
+    bool wireframe;
+};
+const RenderMode renderModes[] = {
+    {"shaded", "default", false},
+    {"wireframe", "wireframe", true},
+    {"debug", "debug", false}};
+const int renderModeCount = sizeof(renderModes) / sizeof(renderModes[0]);
+
+// Everything one frame needs. The viewer's input thread fills these in and hands them to the
+// render thread through a Snapshot; the headless benchmark fills them in from a scripted path.
+struct FrameState
+{
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 model = glm::mat4(1.0f);
+    float zoom = ZOOM;
+    float aspect = 4.0f / 3.0f;
+    int framebufferWidth = 0;
+    int framebufferHeight = 0;
+    int renderMode = 0;
+    unsigned int depth = defaultDepth; // mesh to draw, see GpuMeshCache
+    int variant = 0;                   // index into fractalVariants
+    bool continuous = false;
+    uint64_t inputSequence = 0; // newest input event folded into this state
+    double inputSeconds = 0.0;  // time the input thread spent sampling this state
+    bool profiling = false;
+    bool overlay = false;
+    unsigned int profileDumps = 0; // bumped for every dump request (P)
+};
+
+// Owns the GL objects needed to draw the fractal: the shader variants, the camera uniform
+// buffer, the mesh buffers and the profiler. Construct it with a context current and GLAD
+// loaded; every call must come from the thread that owns that context.
+class Renderer
+{
+public:
+    ShaderLibrary shaders;
+    FrameProfiler profiler;
+    ProfilerOverlay overlay;
+    int inputPhase, uniformsPhase, drawPhase, swapPhase, cullPass, scenePass;
+
+    explicit Renderer(GLADloadproc load)
+        : shaders(load), cameraBuffer(CAMERA_BLOCK_BINDING)
+    {
+        TRACE_SCOPE("renderer init");
+        // submit every variant up front; each one is only waited on when first drawn with
+        shaders.bindUniformBlock("Camera", CAMERA_BLOCK_BINDING);
+        shaders.add("default", "src/shader.vs", "src/shader.fs");
+        shaders.add("wireframe", "src/shader.vs", "src/shader.fs", {"WIREFRAME"});
+        shaders.add("debug", "src/shader.vs", "src/shader.fs", {"DEBUG"});
+        shaders.add("instanced", "src/shader.vs", "src/shader.fs", {"INSTANCED"});
+        shaders.add("overlay", "src/overlay.vs", "src/overlay.fs");
+
+        inputPhase = profiler.addCpuPhase("input");
+        uniformsPhase = profiler.addCpuPhase("uniforms");
+        drawPhase = profiler.addCpuPhase("draw");
+        swapPhase = profiler.addCpuPhase("swap");
+        cullPass = profiler.addGpuPass("cull");
+        scenePass = profiler.addGpuPass("scene");
+        overlay.init();
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        configureMeshAttributes();
+        meshVAO = VAO;
+
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    // draws cache meshes that have subtree bounds through SubtreeCuller from now on; false when
+    // the context is older than 4.3. minPixels as for SubtreeCuller::init.
+    bool enableGpuCulling(float minPixels)
+    {
+        if (!SubtreeCuller::supported())
+            return false;
+        culler.init(minPixels);
+        culling = true;
+        return true;
+    }
+
+    // replaces the mesh; vertices are interleaved position/colour, 6 floats each
+    void upload(const std::vector<float> &vertices)
+    {
+        upload(vertices.data(), vertices.size());
+    }
+    // same from raw memory, e.g. a mapped mesh cache entry
+    void upload(const float *vertices, size_t floats)
+    {
+        TRACE_SCOPE("upload");
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, floats * sizeof(float), vertices, GL_STATIC_DRAW);
+        vertexCount = (GLsizei)(floats / 6);
+        meshVAO = VAO;
+        meshFirst = 0;
+        meshBounds = 0;
+        meshSubtrees = 0;
+        // this VAO has no parent positions
+        morph = 1.0f;
+    }
+
+    // draws a range of someone else's buffer (a GpuMeshCache entry in its arena) from now on,
+    // until the next upload; NULL draws nothing
+    void showMesh(GLuint vertexArray, const GpuMesh *mesh)
+    {
+        meshVAO = vertexArray;
+        meshFirst = mesh ? (GLint)mesh->first : 0;
+        vertexCount = mesh ? mesh->vertices : 0;
+        meshBounds = mesh ? mesh->bounds : 0;
+        meshSubtrees = mesh ? mesh->subtrees : 0;
+    }
+
+    // geomorph factor of the mesh from showMesh: 0 draws it collapsed to the shape one depth up,
+    // 1 as generated
+    void setMorph(float factor) { morph = factor; }
+
+    GLsizei vertices() const { return vertexCount; }
+
+    // draws one frame into the bound framebuffer; the caller swaps or reads back
+    void drawFrame(const FrameState &state)
+    {
+        profiler.addCpuSample(inputPhase, state.inputSeconds);
+
+        if (state.framebufferWidth != viewportWidth || state.framebufferHeight != viewportHeight)
+        {
+            viewportWidth = state.framebufferWidth;
+            viewportHeight = state.framebufferHeight;
+            glViewport(0, 0, viewportWidth, viewportHeight);
+        }
+
+        // finish whatever the driver has completed in the background, then block only on the program we need
+        const RenderMode &mode = renderModes[state.renderMode];
+        Shader *program;
+        {
+            TRACE_SCOPE("shaders");
+            shaders.poll();
+            program = &shaders.get(mode.variant);
+        }
+        Shader &ourShader = *program;
+        const glm::mat4 projection = glm::perspective(glm::radians(state.zoom), state.aspect, 0.1f, 100.0f);
+
+        // the draw commands for the visible subtrees, written by the GPU
+        bool culled = false;
+        if (culling && meshSubtrees > 0)
+        {
+            TRACE_SCOPE("cull");
+            profiler.beginGpu(cullPass);
+            float pixelsPerUnit = state.framebufferHeight / (2.0f * std::tan(glm::radians(state.zoom) / 2.0f));
+            culled = culler.cull(meshBounds, meshSubtrees, meshFirst, projection * state.view * state.model,
+                                 state.view * state.model, pixelsPerUnit);
+            profiler.endGpu(cullPass);
+        }
+
+        // projection and camera/view transformation go into the shared uniform block, once per frame
+        {
+            TRACE_SCOPE("uniforms");
+            profiler.beginCpu(uniformsPhase);
+            CameraBlock cameraBlock;
+            cameraBlock.projection = projection;
+            cameraBlock.view = state.view;
+            cameraBuffer.update(cameraBlock);
+
+            ourShader.use();
+            Uniform<glm::mat4> &modelUniform = modelUniforms[state.renderMode];
+            if (!modelUniform.resolved)
+                modelUniform = ourShader.uniform<glm::mat4>("model");
+            ourShader.set(modelUniform, state.model);
+            Uniform<float> &morphUniform = morphUniforms[state.renderMode];
+            if (!morphUniform.resolved)
+                morphUniform = ourShader.uniform<float>("morph");
+            ourShader.set(morphUniform, morph);
+            profiler.endCpu(uniformsPhase);
+        }
+
+        {
+            TRACE_SCOPE("draw");
+            profiler.beginCpu(drawPhase);
+            profiler.beginGpu(scenePass);
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glPolygonMode(GL_FRONT_AND_BACK, mode.wireframe ? GL_LINE : GL_FILL);
+
+            glBindVertexArray(meshVAO);
+            if (culled)
+                culler.draw(meshSubtrees);
+            else
+                glDrawArrays(GL_TRIANGLES, meshFirst, vertexCount);
+            profiler.endGpu(scenePass);
+            profiler.endCpu(drawPhase);
+        }
+
+        if (state.overlay)
+        {
+            TRACE_SCOPE("overlay");
+            overlay.draw(profiler, shaders.get("overlay").ID);
+        }
+    }
+
+    void destroy()
+    {
+        profiler.destroy();
+        overlay.destroy();
+        culler.destroy();
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        cameraBuffer.destroy();
+        shaders.destroy();
+    }
+
+private:
+    UniformBuffer<CameraBlock> cameraBuffer;
+    // model and morph uniform handles, resolved the first time each mode is drawn
+    Uniform<glm::mat4> modelUniforms[renderModeCount];
+    Uniform<float> morphUniforms[renderModeCount];
+    unsigned int VBO = 0, VAO = 0;
+    unsigned int meshVAO = 0; // VAO, or the arena's vertex array for a GpuMesh
+    GLint meshFirst = 0;
+    GLsizei vertexCount = 0;
+    SubtreeCuller culler;
+    bool culling = false;
+    GLuint meshBounds = 0; // the mesh's SubtreeBound buffer, 0 to draw it whole
+    GLsizei meshSubtrees = 0;
+    float morph = 1.0f;
+    int viewportWidth = 0, viewportHeight = 0;
+};
+#endif
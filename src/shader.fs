@@ -1,8 +1,21 @@
 #version 330 core
+// variants (see shader.vs):
+//   WIREFRAME   drawn with glPolygonMode(GL_LINE); lightened so edges read against the faces' colours
+//   DEBUG       flat facet normals from screen-space derivatives, handy for spotting flipped faces
 in vec3 ourColor;
+#ifdef DEBUG
+in vec3 viewPos;
+#endif
 out vec4 FragColor;
 
 void main()
 {
+#if defined(DEBUG)
+    vec3 n = normalize(cross(dFdx(viewPos), dFdy(viewPos)));
+    FragColor = vec4(n * 0.5 + 0.5, 1.0);
+#elif defined(WIREFRAME)
+    FragColor = vec4(mix(ourColor, vec3(1.0), 0.6), 1.0);
+#else
     FragColor = vec4(ourColor, 1.0);
-}
\ No newline at end of file
+#endif
+}
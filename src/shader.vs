@@ -1,15 +1,44 @@
 #version 330 core
+// variants are built by ShaderLibrary, which injects #defines after the #version line:
+//   INSTANCED   per-instance offset (xyz) and scale (w) at location 2
+//   DEBUG       pass the view-space position on so the fragment stage can shade facets
+// Without INSTANCED the position is blended from the vertex's parent (where it sits one depth up,
+// location 3) to its own by morph, so depth changes can grow in instead of popping.
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
+#ifdef INSTANCED
+layout (location = 2) in vec4 aInstance;
+#else
+layout (location = 3) in vec3 aParent;
+#endif
 
 out vec3 ourColor;
+#ifdef DEBUG
+out vec3 viewPos;
+#endif
+
+// per-frame camera state, shared by every program through one uniform buffer
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+};
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#ifndef INSTANCED
+uniform float morph; // 0: the parent depth's shape, 1: this depth's
+#endif
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+#ifdef INSTANCED
+    vec4 worldPos = model * vec4(aPos * aInstance.w + aInstance.xyz, 1.0);
+#else
+    vec4 worldPos = model * vec4(mix(aParent, aPos, morph), 1.0);
+#endif
+    gl_Position = projection * view * worldPos;
     ourColor = aColor;
-}
\ No newline at end of file
+#ifdef DEBUG
+    viewPos = (view * worldPos).xyz;
+#endif
+}
@@ -0,0 +1,128 @@
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <glad/glad.h>
+
+#include "shader_s.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+
+// Owns every shader program variant. add() submits the compile and link straight away and
+// returns; get() only blocks on a program the first time it is actually used. When the driver
+// exposes KHR_parallel_shader_compile (or the ARB twin) the submitted programs build on driver
+// threads, so startup costs roughly the slowest variant instead of the sum of all of them.
+class ShaderLibrary
+{
+public:
+    // load is the GL proc loader (glfwGetProcAddress); the parallel compile entry point is an
+    // extension that glad was not generated with, so it is resolved here by hand
+    explicit ShaderLibrary(GLADloadproc load)
+    {
+        typedef void (APIENTRYP MaxThreadsProc)(GLuint count);
+        MaxThreadsProc maxThreads = NULL;
+        if (hasExtension("GL_KHR_parallel_shader_compile"))
+            maxThreads = (MaxThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+        else if (hasExtension("GL_ARB_parallel_shader_compile"))
+            maxThreads = (MaxThreadsProc)load("glMaxShaderCompilerThreadsARB");
+        if (maxThreads)
+        {
+            // 0xFFFFFFFF lets the implementation pick as many threads as it likes
+            maxThreads(0xFFFFFFFFu);
+            parallelCompile = true;
+        }
+    }
+
+    bool parallel() const { return parallelCompile; }
+
+    // uniform blocks that every program should be bound to once it has linked
+    void bindUniformBlock(const std::string &blockName, GLuint bindingPoint)
+    {
+        uniformBlocks.emplace_back(blockName, bindingPoint);
+    }
+
+    // submit a variant; defines are injected into both stages right after #version
+    void add(const std::string &name, const char *vertexPath, const char *fragmentPath,
+             const std::vector<std::string> &defines = {})
+    {
+        if (programs.count(name))
+        {
+            std::cout << "WARNING::SHADER_LIBRARY::DUPLICATE_VARIANT: " << name << std::endl;
+            return;
+        }
+        programs.emplace(name, Shader(Shader::readFile(vertexPath, defines),
+                                      Shader::readFile(fragmentPath, defines), Shader::Deferred()));
+        order.push_back(name);
+    }
+
+    bool contains(const std::string &name) const { return programs.count(name) != 0; }
+
+    // returns the program, waiting for its link only if it has not completed yet
+    Shader &get(const std::string &name)
+    {
+        Shader &shader = programs.at(name);
+        finish(shader);
+        return shader;
+    }
+
+    // non-blocking: finishes every program the driver reports as complete
+    void poll()
+    {
+        for (auto &entry : programs)
+        {
+            Shader &shader = entry.second;
+            if (shader.isComplete(parallelCompile))
+                finish(shader);
+        }
+    }
+
+    const std::vector<std::string> &names() const { return order; }
+
+    void destroy()
+    {
+        for (auto &entry : programs)
+            glDeleteProgram(entry.second.ID);
+        programs.clear();
+        order.clear();
+    }
+
+private:
+    // references into an unordered_map stay valid across rehashing, so get() can hand them out
+    std::unordered_map<std::string, Shader> programs;
+    std::vector<std::string> order;
+    std::vector<std::pair<std::string, GLuint>> uniformBlocks;
+    bool parallelCompile = false;
+
+    void finish(Shader &shader)
+    {
+        if (shader.isFinished())
+            return;
+        shader.finish();
+        // not every variant declares every block (the overlay has no camera), so skip quietly
+        for (const auto &block : uniformBlocks)
+            if (glGetUniformBlockIndex(shader.ID, block.first.c_str()) != GL_INVALID_INDEX)
+                shader.bindUniformBlock(block.first, block.second);
+    }
+
+    static bool hasExtension(const char *extension)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            const char *name = (const char *)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+            if (name && std::strcmp(name, extension) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+#endif
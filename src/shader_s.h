@@ -6,71 +6,189 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "program_cache.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
+
+// typed handle to a uniform location resolved once after linking, so the render loop
+// never has to go through glGetUniformLocation and a std::string per call. A uniform the
+// program does not have (or the compiler optimized out) stays resolved at location -1, which
+// glUniform* ignores, so it is looked up and warned about only once.
+template <typename T>
+struct Uniform
+{
+    GLint location = -1;
+    bool resolved = false; // looked up, whether or not the program has it
+    bool valid() const { return location >= 0; }
+};
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
 class Shader
 {
 public:
     unsigned int ID;
+    // tag for the constructor that only submits the compile/link and leaves finish() to the caller
+    struct Deferred {};
+    // tag for the compute program constructor (GL 4.3), deferred like the one above
+    struct Compute {};
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath)
+        : Shader(readFile(vertexPath), readFile(fragmentPath), Deferred())
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
+        finish();
+    }
+    // submits the compile and link without querying any status, so with
+    // KHR_parallel_shader_compile the driver can work on it in the background
+    // ------------------------------------------------------------------------
+    Shader(const std::string &vertexCode, const std::string &fragmentCode, Deferred)
+    {
+        // 1. try the program binary cache before compiling anything
+        useCache = ProgramBinaryCache::supported();
+        cacheKey = useCache ? ProgramBinaryCache::key(vertexCode, fragmentCode) : 0;
+        ID = glCreateProgram();
+        if (useCache && ProgramBinaryCache::load(ID, cacheKey))
         {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
+            fromCache = true;
+            return;
         }
-        catch (std::ifstream::failure& e)
+        if (useCache)
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+            // a rejected binary leaves the program unusable; start again from a fresh object
+            glDeleteProgram(ID);
+            ID = glCreateProgram();
         }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
         // 2. compile shaders
-        unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragment, 1, &fShaderCode, NULL);
         glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
         // shader Program
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
+        if (useCache)
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(ID);
+    }
+    // a compute program; the binary cache keys it as a program without a fragment stage
+    // ------------------------------------------------------------------------
+    Shader(const std::string &computeCode, Compute)
+    {
+        useCache = ProgramBinaryCache::supported();
+        cacheKey = useCache ? ProgramBinaryCache::key(computeCode, "") : 0;
+        ID = glCreateProgram();
+        if (useCache && ProgramBinaryCache::load(ID, cacheKey))
+        {
+            fromCache = true;
+            return;
+        }
+        if (useCache)
+        {
+            glDeleteProgram(ID);
+            ID = glCreateProgram();
+        }
+        const char *cShaderCode = computeCode.c_str();
+        compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, NULL);
+        glCompileShader(compute);
+        glAttachShader(ID, compute);
+        if (useCache)
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-
+    }
+    // non-blocking check whether finish() would have to wait; only meaningful when the
+    // driver exposes KHR_parallel_shader_compile, otherwise every program reports complete
+    // ------------------------------------------------------------------------
+    bool isComplete(bool parallelCompile) const
+    {
+        if (finished || fromCache || !parallelCompile)
+            return true;
+        GLint complete = GL_TRUE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+        return complete == GL_TRUE;
+    }
+    // waits for the link, reports errors, stores the binary and resolves uniforms
+    // ------------------------------------------------------------------------
+    bool finish()
+    {
+        if (finished)
+            return linked;
+        finished = true;
+        if (fromCache)
+            linked = true;
+        else
+        {
+            linked = checkCompileErrors(ID, "PROGRAM");
+            // the compile logs are only worth fetching once we know the link failed
+            if (!linked && compute)
+                checkCompileErrors(compute, "COMPUTE");
+            else if (!linked)
+            {
+                checkCompileErrors(vertex, "VERTEX");
+                checkCompileErrors(fragment, "FRAGMENT");
+            }
+            // delete the shaders as they're linked into our program now and no longer necessary
+            glDeleteShader(vertex);
+            glDeleteShader(fragment);
+            glDeleteShader(compute);
+            vertex = fragment = compute = 0;
+            if (useCache && linked)
+                ProgramBinaryCache::store(ID, cacheKey);
+        }
+        cacheUniformLocations();
+        return linked;
+    }
+    bool isFinished() const { return finished; }
+    // retrieve the source code from filePath, optionally with #defines injected after #version
+    // ------------------------------------------------------------------------
+    static std::string readFile(const char *path, const std::vector<std::string> &defines = {})
+    {
+        std::string code;
+        std::ifstream shaderFile;
+        // ensure ifstream objects can throw exceptions:
+        shaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        try 
+        {
+            shaderFile.open(path);
+            std::stringstream shaderStream;
+            shaderStream << shaderFile.rdbuf();
+            shaderFile.close();
+            code = shaderStream.str();
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << " " << e.what() << std::endl;
+        }
+        if (defines.empty())
+            return code;
+        // #version has to stay the first directive, so the defines go right after it
+        std::string block;
+        for (const std::string &define : defines)
+            block += "#define " + define + "\n";
+        size_t insertAt = 0;
+        if (code.compare(0, 8, "#version") == 0)
+        {
+            size_t eol = code.find('\n');
+            insertAt = eol == std::string::npos ? code.size() : eol + 1;
+            if (eol == std::string::npos)
+                block = "\n" + block;
+        }
+        code.insert(insertAt, block);
+        return code;
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -78,69 +196,153 @@ public:
     { 
         glUseProgram(ID); 
     }
+    // uniform lookups (served from the cache built after linking)
+    // ------------------------------------------------------------------------
+    GLint location(const std::string &name) const
+    {
+        auto it = uniformLocations.find(name);
+        return it != uniformLocations.end() ? it->second : -1;
+    }
+    template <typename T>
+    Uniform<T> uniform(const std::string &name) const
+    {
+        Uniform<T> handle;
+        handle.location = location(name);
+        handle.resolved = true;
+        if (!handle.valid())
+            std::cout << "WARNING::SHADER::UNIFORM_NOT_FOUND: " << name << std::endl;
+        return handle;
+    }
+    // ------------------------------------------------------------------------
+    void bindUniformBlock(const std::string &blockName, GLuint bindingPoint) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID, blockName.c_str());
+        if (index == GL_INVALID_INDEX)
+        {
+            std::cout << "WARNING::SHADER::UNIFORM_BLOCK_NOT_FOUND: " << blockName << std::endl;
+            return;
+        }
+        glUniformBlockBinding(ID, index, bindingPoint);
+    }
+    // typed handle uniform functions
+    // ------------------------------------------------------------------------
+    void set(Uniform<bool> u, bool value) const { glUniform1i(u.location, (int)value); }
+    void set(Uniform<int> u, int value) const { glUniform1i(u.location, value); }
+    void set(Uniform<float> u, float value) const { glUniform1f(u.location, value); }
+    void set(Uniform<glm::vec2> u, const glm::vec2 &value) const { glUniform2fv(u.location, 1, &value[0]); }
+    void set(Uniform<glm::vec3> u, const glm::vec3 &value) const { glUniform3fv(u.location, 1, &value[0]); }
+    void set(Uniform<glm::vec4> u, const glm::vec4 &value) const { glUniform4fv(u.location, 1, &value[0]); }
+    void set(Uniform<glm::mat2> u, const glm::mat2 &mat) const { glUniformMatrix2fv(u.location, 1, GL_FALSE, &mat[0][0]); }
+    void set(Uniform<glm::mat3> u, const glm::mat3 &mat) const { glUniformMatrix3fv(u.location, 1, GL_FALSE, &mat[0][0]); }
+    void set(Uniform<glm::mat4> u, const glm::mat4 &mat) const { glUniformMatrix4fv(u.location, 1, GL_FALSE, &mat[0][0]); }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(location(name), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(location(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(location(name), value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(location(name), 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(location(name), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(location(name), 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(location(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(location(name), 1, &value[0]); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(location(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    std::unordered_map<std::string, GLint> uniformLocations;
+    unsigned int vertex = 0, fragment = 0, compute = 0;
+    bool useCache = false;
+    bool fromCache = false;
+    bool finished = false;
+    bool linked = false;
+    uint64_t cacheKey = 0;
+
+    // resolve every active uniform once; members of uniform blocks report -1 and are skipped
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        uniformLocations.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, &name[0]);
+            std::string uniformName(name.data(), length);
+            GLint loc = glGetUniformLocation(ID, uniformName.c_str());
+            if (loc < 0)
+                continue;
+            uniformLocations[uniformName] = loc;
+            // arrays are reported once, as "name[0]": make them reachable by their bare name too,
+            // and every other element by its own index (locations need not be consecutive)
+            if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = uniformName.substr(0, uniformName.size() - 3);
+                uniformLocations[base] = loc;
+                for (GLint element = 1; element < size; ++element)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    GLint elementLocation = glGetUniformLocation(ID, elementName.c_str());
+                    if (elementLocation >= 0)
+                        uniformLocations[elementName] = elementLocation;
+                }
+            }
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -162,6 +364,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success == GL_TRUE;
     }
 };
 #endif
@@ -0,0 +1,55 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free "latest value" channel between exactly one writer thread and one reader thread
+// (a triple buffer). The writer fills its private slot and publishes it by swapping it with
+// the shared middle slot; the reader swaps the middle slot with its own when a new value is
+// flagged. Neither side ever waits on the other, and the reader always sees the newest complete
+// value the writer published; intermediate values it did not get to are simply skipped.
+template <typename T>
+class Snapshot
+{
+public:
+    Snapshot() : middle(1 << INDEX_SHIFT), writeIndex(0), readIndex(2) {}
+
+    // writer side: the slot to fill before calling publish()
+    T &back() { return slots[writeIndex]; }
+
+    void publish()
+    {
+        uint32_t previous = middle.exchange((writeIndex << INDEX_SHIFT) | FRESH, std::memory_order_acq_rel);
+        writeIndex = previous >> INDEX_SHIFT;
+    }
+
+    void publish(const T &value)
+    {
+        back() = value;
+        publish();
+    }
+
+    // reader side: copies the latest published value into out; returns false if nothing new
+    // arrived since the previous call (out is left untouched then)
+    bool read(T &out)
+    {
+        if (!(middle.load(std::memory_order_acquire) & FRESH))
+            return false;
+        uint32_t previous = middle.exchange(readIndex << INDEX_SHIFT, std::memory_order_acq_rel);
+        readIndex = previous >> INDEX_SHIFT;
+        out = slots[readIndex];
+        return true;
+    }
+
+private:
+    static const uint32_t FRESH = 1;
+    static const uint32_t INDEX_SHIFT = 1;
+
+    T slots[3];
+    // index of the shared slot plus the FRESH flag, packed so one exchange moves both
+    std::atomic<uint32_t> middle;
+    uint32_t writeIndex; // only touched by the writer
+    uint32_t readIndex;  // only touched by the reader
+};
+#endif
@@ -0,0 +1,58 @@
+#version 430 core
+// One invocation per subtree of the mesh being drawn (see SubtreeCuller in subtree_cull.h): tests
+// the subtree's bounding sphere against the view frustum and its projected size, and writes the
+// subtree's draw command for glMultiDrawArraysIndirect. Culled subtrees get instanceCount 0, so
+// the command list keeps its length and the CPU never has to read anything back.
+layout (local_size_x = 64) in;
+
+struct Subtree
+{
+    vec4 sphere;   // centre xyz and radius w, in object space
+    uint first;    // vertex range within the mesh
+    uint count;
+    uvec2 padding;
+};
+
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint first;
+    uint baseInstance;
+};
+
+layout (std430, binding = 0) readonly buffer Subtrees
+{
+    Subtree subtrees[];
+};
+
+layout (std430, binding = 1) writeonly buffer Commands
+{
+    DrawCommand commands[];
+};
+
+uniform uint subtreeCount;
+uniform uint baseVertex;     // the mesh's first vertex in the arena
+uniform vec4 planes[6];      // frustum planes in object space, normalised, pointing inwards
+uniform vec3 eye;            // camera position in object space
+uniform float pixelsPerUnit; // pixels a unit length covers at distance 1
+uniform float minPixels;     // subtrees whose bounds cover fewer pixels across are skipped
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= subtreeCount)
+        return;
+    Subtree subtree = subtrees[i];
+    vec3 center = subtree.sphere.xyz;
+    float radius = subtree.sphere.w;
+
+    bool visible = true;
+    for (int p = 0; p < 6; ++p)
+        visible = visible && dot(planes[p].xyz, center) + planes[p].w >= -radius;
+    float distance = length(center - eye);
+    if (distance > radius && 2.0 * radius * pixelsPerUnit < minPixels * distance)
+        visible = false;
+
+    commands[i] = DrawCommand(subtree.count, visible ? 1u : 0u, baseVertex + subtree.first, 0u);
+}
@@ -0,0 +1,180 @@
+#ifndef SUBTREE_CULL_H
+#define SUBTREE_CULL_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "shader_s.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+// bounds of one run of a mesh's vertices, laid out as the Subtree struct of subtree_cull.cs (std430)
+struct SubtreeBound
+{
+    float center[3];
+    float radius;
+    GLuint first; // vertex range within the mesh
+    GLuint count;
+    GLuint padding[2];
+};
+
+// Every variant generates depth first, so a run of consecutive triangles is one spatially compact
+// piece of the fractal. Meshes are cut into at most this many equal runs; for the koch rules they
+// are exactly the depth-3 subtrees of planSubtrees (4 * 6^3), in the same order.
+const size_t cullSubtreeCount = 864;
+
+// one bounding sphere per run, around the centre of the run's bounding box; vertices are
+// interleaved position/colour, 18 floats per triangle. With parents (3 floats per vertex), the
+// run's parent positions are enclosed too, so the sphere holds at every morph factor: a parent
+// need not lie within its own run (an apex's parent is the centroid of its whole midpoint
+// triangle, which short runs split).
+inline std::vector<SubtreeBound> subtreeBounds(const float *vertices, size_t triangles, const float *parents = NULL)
+{
+    std::vector<SubtreeBound> bounds;
+    if (triangles == 0)
+        return bounds;
+    const size_t runs = std::min(triangles, cullSubtreeCount);
+    const size_t runTriangles = (triangles + runs - 1) / runs;
+    for (size_t start = 0; start < triangles; start += runTriangles)
+    {
+        const size_t end = std::min(triangles, start + runTriangles);
+        glm::vec3 lo(vertices[start * 18], vertices[start * 18 + 1], vertices[start * 18 + 2]), hi = lo;
+        for (size_t v = start * 3; v < end * 3; ++v)
+        {
+            glm::vec3 p(vertices[v * 6], vertices[v * 6 + 1], vertices[v * 6 + 2]);
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+            if (parents)
+            {
+                glm::vec3 parent(parents[v * 3], parents[v * 3 + 1], parents[v * 3 + 2]);
+                lo = glm::min(lo, parent);
+                hi = glm::max(hi, parent);
+            }
+        }
+        glm::vec3 center = (lo + hi) * 0.5f;
+        float radius = 0.0f;
+        for (size_t v = start * 3; v < end * 3; ++v)
+        {
+            glm::vec3 p(vertices[v * 6], vertices[v * 6 + 1], vertices[v * 6 + 2]);
+            radius = std::max(radius, glm::length(p - center));
+            if (parents)
+            {
+                glm::vec3 parent(parents[v * 3], parents[v * 3 + 1], parents[v * 3 + 2]);
+                radius = std::max(radius, glm::length(parent - center));
+            }
+        }
+        SubtreeBound bound = {{center.x, center.y, center.z}, radius, (GLuint)(start * 3),
+                              (GLuint)((end - start) * 3), {0, 0}};
+        bounds.push_back(bound);
+    }
+    return bounds;
+}
+
+// Frustum and size culling of mesh subtrees on the GPU. cull() runs subtree_cull.cs over the
+// mesh's SubtreeBound buffer, which writes one draw command per subtree into an indirect buffer;
+// draw() then submits all of them with a single glMultiDrawArraysIndirect. Per frame the CPU
+// only sets a handful of uniforms, whatever the number of subtrees. Needs GL 4.3; construct and
+// call with that context current.
+class SubtreeCuller
+{
+public:
+    static bool supported() { return GLAD_GL_VERSION_4_3 != 0; }
+
+    // submits the compute program; minPixels is the smallest on-screen size, across, a subtree's
+    // bounds may have and still be drawn
+    void init(float minimumPixels)
+    {
+        minPixels = minimumPixels;
+        program.reset(new Shader(Shader::readFile("src/subtree_cull.cs"), Shader::Compute()));
+        glGenBuffers(1, &commands);
+    }
+
+    // writes the draw commands of a mesh: bounds holds its subtrees, baseVertex is where it
+    // starts in its vertex buffer. clip is projection * view * model, viewModel view * model.
+    // false when the compute program failed to build; draw the mesh as a whole then.
+    bool cull(GLuint bounds, GLsizei subtrees, GLint baseVertex, const glm::mat4 &clip, const glm::mat4 &viewModel,
+              float pixelsPerUnit)
+    {
+        if (!program->isFinished())
+        {
+            if (!program->finish())
+                failed = true;
+            subtreeCountLocation = program->location("subtreeCount");
+            baseVertexLocation = program->location("baseVertex");
+            planesLocation = program->location("planes");
+            eyeUniform = program->uniform<glm::vec3>("eye");
+            pixelsPerUnitUniform = program->uniform<float>("pixelsPerUnit");
+            minPixelsUniform = program->uniform<float>("minPixels");
+        }
+        if (failed)
+            return false;
+        if (subtrees > capacity)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, commands);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, subtrees * 4 * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+            capacity = subtrees;
+        }
+
+        // Gribb-Hartmann: the planes are sums and differences of the clip matrix's rows, and in
+        // object space because model is part of it
+        glm::vec4 planes[6];
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; ++i)
+            rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+        for (int i = 0; i < 3; ++i)
+        {
+            planes[i * 2] = rows[3] + rows[i];
+            planes[i * 2 + 1] = rows[3] - rows[i];
+        }
+        for (glm::vec4 &plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+        glm::vec3 eye = glm::vec3(glm::inverse(viewModel)[3]);
+
+        program->use();
+        glUniform1ui(subtreeCountLocation, (GLuint)subtrees);
+        glUniform1ui(baseVertexLocation, (GLuint)baseVertex);
+        glUniform4fv(planesLocation, 6, &planes[0][0]);
+        program->set(eyeUniform, eye);
+        program->set(pixelsPerUnitUniform, pixelsPerUnit);
+        program->set(minPixelsUniform, minPixels);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bounds);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commands);
+        glDispatchCompute((GLuint)(subtrees + 63) / 64, 1, 1);
+        // the draw reads the commands as indirect arguments
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+        return true;
+    }
+
+    // draws the commands of the last cull() from the bound vertex array
+    void draw(GLsizei subtrees)
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands);
+        glMultiDrawArraysIndirect(GL_TRIANGLES, NULL, subtrees, 0);
+    }
+
+    void destroy()
+    {
+        if (program)
+            glDeleteProgram(program->ID);
+        program.reset();
+        glDeleteBuffers(1, &commands);
+        commands = 0;
+        capacity = 0;
+    }
+
+private:
+    std::unique_ptr<Shader> program;
+    bool failed = false;
+    GLuint commands = 0;
+    GLsizei capacity = 0;
+    float minPixels = 1.0f;
+    // Uniform<T> has no uint or array setters; these go through raw locations
+    GLint subtreeCountLocation = -1, baseVertexLocation = -1, planesLocation = -1;
+    Uniform<glm::vec3> eyeUniform;
+    Uniform<float> pixelsPerUnitUniform, minPixelsUniform;
+};
+#endif
@@ -0,0 +1,118 @@
+#ifndef SUBTREE_PLAN_H
+#define SUBTREE_PLAN_H
+
+#include "koch_generator.h"
+
+#include <vector>
+
+// Splits KochGenerator::generate's recursion into independent subtrees. Expanding drawKT down to
+// a split depth gives a list of calls whose outputs, run one after another, are byte-for-byte the
+// mesh generate() builds in one go, and each call's triangle count is known up front. That lets
+// callers generate the mesh in bounded chunks, or run subtrees anywhere and still know where
+// their triangles land.
+struct SubtreeTask
+{
+    std::vector<float> a, b, c;
+    int depth;
+    bool leaf;  // a single drawTriangle(a, b, c), as drawKT emits the corners one level above the limit
+    unsigned long long firstTriangle;
+    unsigned long long triangles;
+};
+
+// triangles drawKT emits from depth down to maxDepth under the classic corner rule, an upper
+// bound for every other one
+inline unsigned long long subtreeTriangles(int depth, unsigned int maxDepth)
+{
+    unsigned long long count = 1;
+    for (int i = depth; i < (int)maxDepth; ++i)
+        count *= 6;
+    return count;
+}
+
+// appends the tasks of drawKT(a, b, c, depth) expanded down to splitDepth, in emission order
+inline void planSubtree(const KochGenerator &generator, const std::vector<float> &a, const std::vector<float> &b,
+                        const std::vector<float> &c, int depth, int splitDepth, std::vector<SubtreeTask> &tasks)
+{
+    const unsigned int maxDepth = generator.depth();
+    unsigned long long first = tasks.empty() ? 0 : tasks.back().firstTriangle + tasks.back().triangles;
+    if (depth >= splitDepth || depth >= (int)maxDepth)
+    {
+        tasks.push_back({a, b, c, depth, false, first, generator.subtreeTriangles(depth)});
+        return;
+    }
+    // the same construction and order as drawKT
+    std::vector<float> mid1, mid2, mid3, newC1;
+    generator.subdivide(a, b, c, mid1, mid2, mid3, newC1);
+
+    planSubtree(generator, mid1, mid2, newC1, depth + 1, splitDepth, tasks);
+    planSubtree(generator, mid2, mid3, newC1, depth + 1, splitDepth, tasks);
+    planSubtree(generator, mid3, mid1, newC1, depth + 1, splitDepth, tasks);
+    if (generator.recursesCorners(depth))
+    {
+        planSubtree(generator, a, mid2, mid1, depth + 1, splitDepth, tasks);
+        planSubtree(generator, b, mid3, mid2, depth + 1, splitDepth, tasks);
+        planSubtree(generator, c, mid1, mid3, depth + 1, splitDepth, tasks);
+    }
+    else
+    {
+        const std::vector<float> *corners[3][3] = {{&mid2, &mid1, &a}, {&mid3, &mid2, &b}, {&mid1, &mid3, &c}};
+        for (const auto &corner : corners)
+        {
+            first = tasks.back().firstTriangle + tasks.back().triangles;
+            tasks.push_back({*corner[0], *corner[1], *corner[2], depth + 1, true, first, 1});
+        }
+    }
+}
+
+// the whole fractal as subtrees rooted at splitDepth (clamped to the depth): 4 * 6^splitDepth tasks
+inline std::vector<SubtreeTask> planSubtrees(const KochGenerator &generator, int splitDepth)
+{
+    std::vector<SubtreeTask> tasks;
+    const KochConfig &config = generator.config();
+    for (int i = 0; i < 4; ++i)
+        planSubtree(generator, config.faces[i][0], config.faces[i][1], config.faces[i][2], 0, splitDepth, tasks);
+    return tasks;
+}
+
+// shallowest split whose subtrees stay within maxTriangles each
+inline int splitDepthFor(unsigned int maxDepth, unsigned long long maxTriangles)
+{
+    int split = 0;
+    while (split < (int)maxDepth && subtreeTriangles(split, maxDepth) > maxTriangles)
+        ++split;
+    return split;
+}
+
+// appends the task's triangles to vertices
+inline void runSubtree(const KochGenerator &generator, const SubtreeTask &task, std::vector<float> &vertices)
+{
+    if (task.leaf)
+        generator.drawTriangle(task.a, task.b, task.c, vertices);
+    else
+        generator.drawKT(task.a, task.b, task.c, task.depth, vertices);
+}
+
+// Generates the mesh in order, handing it over in chunks of at most maxTriangles (or one
+// subtree, if that is larger) so the whole mesh never has to be in memory. The chunk buffer
+// is reused; callback(const std::vector<float> &vertices, unsigned long long firstTriangle).
+template <typename Callback>
+void generateMeshChunked(const KochGenerator &generator, unsigned long long maxTriangles, Callback callback)
+{
+    std::vector<SubtreeTask> tasks = planSubtrees(generator, splitDepthFor(generator.depth(), maxTriangles));
+    std::vector<float> chunk;
+    unsigned long long chunkFirst = 0;
+    for (const SubtreeTask &task : tasks)
+    {
+        if (!chunk.empty() && chunk.size() / 18 + task.triangles > maxTriangles)
+        {
+            callback((const std::vector<float> &)chunk, chunkFirst);
+            chunk.clear();
+        }
+        if (chunk.empty())
+            chunkFirst = task.firstTriangle;
+        runSubtree(generator, task, chunk);
+    }
+    if (!chunk.empty())
+        callback((const std::vector<float> &)chunk, chunkFirst);
+}
+#endif
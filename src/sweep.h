@@ -0,0 +1,384 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "koch_generator.h"
+#include "subtree_plan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Parameter sweeps over generator variants: `koch_tetrahedron sweep`.
+//
+// A grid of depths, apex height ratios, corner rules and base shapes is expanded into one
+// KochConfig per combination, and a pool of workers pulls variants from a shared queue, generates
+// each one and reduces it to a row of statistics. Nothing is kept per variant but that row, so a
+// batch of thousands of small variants costs little more than generating them.
+//
+//   koch_tetrahedron sweep --depths 1-5 --apex 0:1.2:0.1 --corners all,0,1 --shapes regular,squashed --out sweep.csv
+
+// base tetrahedra a sweep can start from; each one rewrites the faces of a default KochConfig
+struct BaseShape
+{
+    const char *name;
+    void (*apply)(KochConfig &config);
+};
+const BaseShape baseShapes[] = {
+    {"regular", [](KochConfig &) {}},
+    // the (.5, .5, .5) corner pulled out along its diagonal to (1, 1, 1)
+    {"elongated", [](KochConfig &config)
+     {
+         for (auto &face : config.faces)
+             for (std::vector<float> &vertex : face)
+                 if (vertex[0] > 0.0f && vertex[1] > 0.0f && vertex[2] > 0.0f)
+                     vertex = {1.0f, 1.0f, 1.0f};
+     }},
+    // half as tall along z
+    {"squashed", [](KochConfig &config)
+     {
+         for (auto &face : config.faces)
+             for (std::vector<float> &vertex : face)
+                 vertex[2] *= 0.5f;
+     }}};
+
+inline const BaseShape *findBaseShape(const char *name)
+{
+    for (const BaseShape &shape : baseShapes)
+        if (std::string(shape.name) == name)
+            return &shape;
+    return NULL;
+}
+
+struct SweepGrid
+{
+    std::vector<unsigned int> depths = {defaultDepth};
+    std::vector<float> apexHeightRatios = {std::sqrt(2.0f / 3.0f)};
+    std::vector<unsigned int> cornerLevels = {~0u};
+    std::vector<const BaseShape *> shapes = {&baseShapes[0]};
+};
+
+struct SweepVariant
+{
+    const BaseShape *shape;
+    KochConfig config;
+};
+
+// every combination, shape-major and depth-minor
+inline std::vector<SweepVariant> expandSweepGrid(const SweepGrid &grid)
+{
+    std::vector<SweepVariant> variants;
+    for (const BaseShape *shape : grid.shapes)
+        for (unsigned int corners : grid.cornerLevels)
+            for (float apex : grid.apexHeightRatios)
+                for (unsigned int depth : grid.depths)
+                {
+                    SweepVariant variant = {shape, KochConfig()};
+                    shape->apply(variant.config);
+                    variant.config.depth = depth;
+                    variant.config.apexHeightRatio = apex;
+                    variant.config.cornerLevels = corners;
+                    variants.push_back(variant);
+                }
+    return variants;
+}
+
+struct SweepStats
+{
+    unsigned long long triangles = 0;
+    double area = 0.0;
+    float lo[3] = {0.0f, 0.0f, 0.0f}, hi[3] = {0.0f, 0.0f, 0.0f};
+    // triangles with the same three corners (either winding) as at least one other triangle
+    unsigned long long coincident = 0;
+    double seconds = 0.0;
+};
+
+// Vertices are snapped to a 2^-20 grid before comparing, far coarser than the float noise of
+// the midpoint construction (~1e-8) and far finer than any feature at the depths a sweep runs.
+inline uint64_t sweepVertexKey(const float *v)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (int k = 0; k < 3; ++k)
+    {
+        hash ^= (uint64_t)std::llround((double)v[k] * 1048576.0);
+        hash *= 1099511628211ull;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+// one triangle as an order-independent key of its corners
+inline uint64_t sweepFaceKey(const float *triangle)
+{
+    uint64_t keys[3] = {sweepVertexKey(triangle), sweepVertexKey(triangle + 6), sweepVertexKey(triangle + 12)};
+    std::sort(keys, keys + 3);
+    return (keys[0] * 31 + keys[1]) * 1000003 + keys[2];
+}
+
+// Generates one variant in bounded chunks and reduces it to its statistics. faceKeys is the
+// worker's scratch buffer (8 bytes per triangle), reused across variants.
+inline SweepStats measureVariant(const KochConfig &config, std::vector<uint64_t> &faceKeys)
+{
+    auto start = std::chrono::steady_clock::now();
+    const KochGenerator generator(config);
+    SweepStats stats;
+    faceKeys.clear();
+    faceKeys.reserve((size_t)generator.triangles());
+    generateMeshChunked(generator, 1ull << 16,
+                        [&](const std::vector<float> &vertices, unsigned long long)
+                        {
+                            for (size_t i = 0; i + 18 <= vertices.size(); i += 18)
+                            {
+                                const float *t = &vertices[i];
+                                for (int j = 0; j < 3; ++j)
+                                    for (int k = 0; k < 3; ++k)
+                                    {
+                                        float v = t[j * 6 + k];
+                                        bool first = stats.triangles == 0 && j == 0;
+                                        stats.lo[k] = first || v < stats.lo[k] ? v : stats.lo[k];
+                                        stats.hi[k] = first || v > stats.hi[k] ? v : stats.hi[k];
+                                    }
+                                double ab[3], ac[3];
+                                for (int k = 0; k < 3; ++k)
+                                {
+                                    ab[k] = (double)t[6 + k] - t[k];
+                                    ac[k] = (double)t[12 + k] - t[k];
+                                }
+                                double cx = ab[1] * ac[2] - ab[2] * ac[1];
+                                double cy = ab[2] * ac[0] - ab[0] * ac[2];
+                                double cz = ab[0] * ac[1] - ab[1] * ac[0];
+                                stats.area += 0.5 * std::sqrt(cx * cx + cy * cy + cz * cz);
+                                faceKeys.push_back(sweepFaceKey(t));
+                                ++stats.triangles;
+                            }
+                        });
+
+    std::sort(faceKeys.begin(), faceKeys.end());
+    for (size_t i = 0; i < faceKeys.size();)
+    {
+        size_t run = i + 1;
+        while (run < faceKeys.size() && faceKeys[run] == faceKeys[i])
+            ++run;
+        if (run - i > 1)
+            stats.coincident += run - i;
+        i = run;
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+// Measures every variant on `threads` workers (0: all hardware threads). Workers take variants
+// from one shared queue, biggest first so a deep variant never starts last, and report(index,
+// stats) is called under a lock in variant order as soon as each prefix of the batch is done.
+template <typename Report>
+void runSweep(const std::vector<SweepVariant> &variants, unsigned int threads, Report report)
+{
+    std::vector<size_t> queue(variants.size());
+    for (size_t i = 0; i < queue.size(); ++i)
+        queue[i] = i;
+    std::vector<unsigned long long> cost(variants.size());
+    for (size_t i = 0; i < variants.size(); ++i)
+        cost[i] = KochGenerator(variants[i].config).triangles();
+    std::stable_sort(queue.begin(), queue.end(), [&cost](size_t a, size_t b) { return cost[a] > cost[b]; });
+
+    std::vector<SweepStats> results(variants.size());
+    std::vector<char> finished(variants.size(), 0);
+    size_t reported = 0;
+    std::mutex reportMutex;
+    std::atomic<size_t> next(0);
+    threads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned int)std::min<size_t>(threads, std::max<size_t>(1, variants.size()));
+    auto work = [&]
+    {
+        std::vector<uint64_t> faceKeys;
+        for (size_t n = next++; n < queue.size(); n = next++)
+        {
+            size_t index = queue[n];
+            SweepStats stats = measureVariant(variants[index].config, faceKeys);
+            std::lock_guard<std::mutex> lock(reportMutex);
+            results[index] = stats;
+            finished[index] = 1;
+            for (; reported < variants.size() && finished[reported]; ++reported)
+                report(reported, (const SweepStats &)results[reported]);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; ++t)
+        workers.emplace_back(work);
+    work();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+struct SweepOptions
+{
+    SweepGrid grid;
+    unsigned int threads = 0; // 0: all hardware threads
+    std::string outPath;      // CSV, stdout when empty
+};
+
+// "1-5" or "1,3,5"
+inline bool parseSweepDepths(const char *value, std::vector<unsigned int> &depths)
+{
+    depths.clear();
+    unsigned int first = 0, last = 0;
+    if (std::sscanf(value, "%u-%u", &first, &last) == 2 && std::strchr(value, ',') == NULL)
+        for (unsigned int d = first; d <= last; ++d)
+            depths.push_back(d);
+    else
+        for (const char *p = value; *p; p += *p == ',')
+        {
+            char *end = NULL;
+            depths.push_back((unsigned int)std::strtoul(p, &end, 10));
+            if (end == p)
+                return false;
+            p = end;
+        }
+    return !depths.empty();
+}
+
+// "from:to:step" or "0.5,0.8,1"
+inline bool parseSweepRatios(const char *value, std::vector<float> &ratios)
+{
+    ratios.clear();
+    double from = 0.0, to = 0.0, step = 0.0;
+    if (std::sscanf(value, "%lf:%lf:%lf", &from, &to, &step) == 3)
+    {
+        if (step <= 0.0)
+            return false;
+        // by index, so accumulated rounding neither drops nor adds the last value
+        for (long i = 0; from + i * step <= to + step * 1e-6; ++i)
+            ratios.push_back((float)(from + i * step));
+    }
+    else
+        for (const char *p = value; *p; p += *p == ',')
+        {
+            char *end = NULL;
+            ratios.push_back(std::strtof(p, &end));
+            if (end == p)
+                return false;
+            p = end;
+        }
+    return !ratios.empty();
+}
+
+// "all,0,1,2": levels at which corners still recurse, "all" for the classic rule
+inline bool parseSweepCorners(const char *value, std::vector<unsigned int> &levels)
+{
+    levels.clear();
+    for (const char *p = value; *p; p += *p == ',')
+    {
+        if (std::strncmp(p, "all", 3) == 0)
+        {
+            levels.push_back(~0u);
+            p += 3;
+            continue;
+        }
+        char *end = NULL;
+        levels.push_back((unsigned int)std::strtoul(p, &end, 10));
+        if (end == p)
+            return false;
+        p = end;
+    }
+    return !levels.empty();
+}
+
+inline bool parseSweepShapes(const char *value, std::vector<const BaseShape *> &shapes)
+{
+    shapes.clear();
+    std::string list = value;
+    for (size_t start = 0; start <= list.size();)
+    {
+        size_t comma = std::min(list.find(',', start), list.size());
+        const BaseShape *shape = findBaseShape(list.substr(start, comma - start).c_str());
+        if (!shape)
+        {
+            std::cout << "unknown shape: " << list.substr(start, comma - start) << " (available:";
+            for (const BaseShape &known : baseShapes)
+                std::cout << " " << known.name;
+            std::cout << ")" << std::endl;
+            return false;
+        }
+        shapes.push_back(shape);
+        start = comma + 1;
+    }
+    return true;
+}
+
+inline bool parseSweepArgs(int argc, char **argv, SweepOptions &options)
+{
+    bool ok = true;
+    for (int i = 0; i < argc && ok; ++i)
+    {
+        std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (arg == "--depths" && value)
+            ok = parseSweepDepths(argv[++i], options.grid.depths);
+        else if (arg == "--apex" && value)
+            ok = parseSweepRatios(argv[++i], options.grid.apexHeightRatios);
+        else if (arg == "--corners" && value)
+            ok = parseSweepCorners(argv[++i], options.grid.cornerLevels);
+        else if (arg == "--shapes" && value)
+            ok = parseSweepShapes(argv[++i], options.grid.shapes);
+        else if (arg == "--threads" && value)
+            options.threads = (unsigned int)std::atoi(argv[++i]);
+        else if (arg == "--out" && value)
+            options.outPath = argv[++i];
+        else
+            ok = false;
+    }
+    for (unsigned int depth : options.grid.depths)
+        if (depth > 9)
+        {
+            std::cout << "sweep depths go up to 9 (every variant is generated in full), got " << depth << std::endl;
+            return false;
+        }
+    if (!ok)
+        std::cout << "usage: koch_tetrahedron sweep [--depths 1-5|1,3] [--apex from:to:step|a,b] [--corners all,0,1]\n"
+                     "                              [--shapes regular,elongated,squashed] [--threads N] [--out sweep.csv]"
+                  << std::endl;
+    return ok;
+}
+
+inline int runSweepCommand(const SweepOptions &options)
+{
+    std::vector<SweepVariant> variants = expandSweepGrid(options.grid);
+    FILE *out = options.outPath.empty() ? stdout : std::fopen(options.outPath.c_str(), "w");
+    if (!out)
+    {
+        std::cout << "ERROR::SWEEP::FILE_NOT_WRITABLE: " << options.outPath << std::endl;
+        return 1;
+    }
+    std::fprintf(out, "variant,shape,depth,apex_ratio,corner_levels,triangles,area,min_x,min_y,min_z,max_x,max_y,max_z,"
+                      "coincident,seconds\n");
+    auto start = std::chrono::steady_clock::now();
+    runSweep(variants, options.threads,
+             [&](size_t index, const SweepStats &stats)
+             {
+                 const SweepVariant &variant = variants[index];
+                 char corners[16] = "all";
+                 if (variant.config.cornerLevels != ~0u)
+                     std::snprintf(corners, sizeof(corners), "%u", variant.config.cornerLevels);
+                 std::fprintf(out, "%zu,%s,%u,%.6g,%s,%llu,%.9g,%g,%g,%g,%g,%g,%g,%llu,%.6f\n", index,
+                              variant.shape->name, variant.config.depth, variant.config.apexHeightRatio, corners,
+                              stats.triangles, stats.area, stats.lo[0], stats.lo[1], stats.lo[2], stats.hi[0],
+                              stats.hi[1], stats.hi[2], stats.coincident, stats.seconds);
+             });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (out != stdout)
+    {
+        std::fclose(out);
+        std::printf("%zu variants in %.3f s -> %s\n", variants.size(), seconds, options.outPath.c_str());
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,208 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+// Lightweight scoped trace markers, exported as Chrome trace-event JSON (loads in Perfetto and
+// chrome://tracing).
+//
+//     TRACE_SCOPE("upload");
+//
+// records a complete ("X") event covering the rest of the enclosing scope. Names must be string
+// literals (or otherwise outlive the trace) since only the pointer is stored. Every thread
+// writes into its own fixed-size ring, so recording takes no lock and never allocates; the ring
+// is registered once, on the thread's first event. When tracing is off a scope costs one relaxed
+// atomic load. Buffers outlive their threads, so short-lived workers still show up in the export;
+// a thread that exits hands its ring to the next new thread, so workers started over and over
+// (generateParallel's, once per mesh) share a few rings and their tracks instead of each one
+// keeping another ring alive until exit.
+class Trace
+{
+public:
+    static const size_t RING_EVENTS = 1 << 16; // per thread; the oldest events are overwritten
+
+    static void start()
+    {
+        epoch();
+        enabledFlag().store(true, std::memory_order_relaxed);
+    }
+    static void stop() { enabledFlag().store(false, std::memory_order_relaxed); }
+    static bool enabled() { return enabledFlag().load(std::memory_order_relaxed); }
+
+    // shows up as the thread's track name in the viewer
+    static void setThreadName(const char *name)
+    {
+        if (enabled())
+            buffer().name = name;
+    }
+
+    static uint64_t now()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - epoch())
+            .count();
+    }
+
+    static void record(const char *name, uint64_t start, uint64_t end)
+    {
+        ThreadBuffer &ring = buffer();
+        uint64_t head = ring.head.load(std::memory_order_relaxed);
+        Event &event = ring.events[head % RING_EVENTS];
+        event.name = name;
+        event.start = start;
+        event.duration = end - start;
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+
+    // Writes everything recorded so far. Meant to run once the traced work has stopped; a
+    // thread still recording meanwhile can at worst have its newest events cut off.
+    static bool write(const std::string &path)
+    {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file)
+        {
+            std::cout << "ERROR::TRACE::CANNOT_WRITE: " << path << std::endl;
+            return false;
+        }
+        Registry &registry = registryInstance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        char line[256];
+        size_t total = 0;
+        for (const auto &ring : registry.buffers)
+        {
+            std::snprintf(line, sizeof(line),
+                          "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+                          first ? "" : ",\n", ring->tid, ring->name.c_str());
+            file << line;
+            first = false;
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t begin = head > RING_EVENTS ? head - RING_EVENTS : 0;
+            for (uint64_t i = begin; i < head; ++i)
+            {
+                const Event &event = ring->events[i % RING_EVENTS];
+                std::snprintf(line, sizeof(line),
+                              ",\n{\"ph\": \"X\", \"name\": \"%s\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+                              event.name, ring->tid, event.start / 1000.0, event.duration / 1000.0);
+                file << line;
+                ++total;
+            }
+        }
+        file << "\n]}\n";
+        std::cout << "trace with " << total << " events written to " << path << std::endl;
+        return true;
+    }
+
+private:
+    struct Event
+    {
+        const char *name;
+        uint64_t start;
+        uint64_t duration;
+    };
+    struct ThreadBuffer
+    {
+        std::string name;
+        uint32_t tid = 0;
+        std::unique_ptr<Event[]> events;
+        std::atomic<uint64_t> head{0};
+    };
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        std::vector<ThreadBuffer *> idle; // rings of threads that have exited
+    };
+    // returns the thread's ring to the registry when the thread exits
+    struct RingOwner
+    {
+        ThreadBuffer *ring = NULL;
+        ~RingOwner()
+        {
+            if (!ring)
+                return;
+            Registry &registry = registryInstance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.idle.push_back(ring);
+        }
+    };
+
+    static std::atomic<bool> &enabledFlag()
+    {
+        static std::atomic<bool> flag(false);
+        return flag;
+    }
+
+    static std::chrono::steady_clock::time_point epoch()
+    {
+        static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        return start;
+    }
+
+    static Registry &registryInstance()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    // the calling thread's ring: an exited thread's if there is one, otherwise created and
+    // registered on first use
+    static ThreadBuffer &buffer()
+    {
+        thread_local RingOwner owner;
+        if (!owner.ring)
+        {
+            Registry &registry = registryInstance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            if (!registry.idle.empty())
+            {
+                owner.ring = registry.idle.back();
+                registry.idle.pop_back();
+                // the earlier events stay, on the same track, under the new thread's name
+                owner.ring->name = "thread " + std::to_string(owner.ring->tid);
+            }
+            else
+            {
+                std::unique_ptr<ThreadBuffer> created(new ThreadBuffer());
+                created->events.reset(new Event[RING_EVENTS]);
+                created->tid = (uint32_t)registry.buffers.size() + 1;
+                created->name = "thread " + std::to_string(created->tid);
+                owner.ring = created.get();
+                registry.buffers.push_back(std::move(created));
+            }
+        }
+        return *owner.ring;
+    }
+};
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *label) : name(Trace::enabled() ? label : NULL), start(name ? Trace::now() : 0) {}
+    ~TraceScope()
+    {
+        if (name)
+            Trace::record(name, start, Trace::now());
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name;
+    uint64_t start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#endif
@@ -0,0 +1,55 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <type_traits>
+
+// binding points shared between the C++ side and the uniform blocks declared in the shaders
+const GLuint CAMERA_BLOCK_BINDING = 0;
+
+// mirrors "layout (std140) uniform Camera" in shader.vs. mat4 columns are vec4s, so std140
+// adds no padding as long as only mat4/vec4 members are added here.
+struct CameraBlock
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+};
+
+// A uniform buffer object holding one std140 block, bound to a fixed binding point so every
+// program that declares the block sees the same data after a single upload per frame
+template <typename Block>
+class UniformBuffer
+{
+    static_assert(std::is_standard_layout<Block>::value, "uniform blocks must be standard layout");
+    static_assert(sizeof(Block) % 16 == 0, "std140 blocks must be padded to a multiple of 16 bytes");
+
+public:
+    unsigned int ID;
+    GLuint binding;
+
+    explicit UniformBuffer(GLuint bindingPoint) : binding(bindingPoint)
+    {
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+
+    // upload the whole block; called once per frame rather than once per draw
+    void update(const Block &block) const
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void destroy()
+    {
+        glDeleteBuffers(1, &ID);
+        ID = 0;
+    }
+};
+#endif